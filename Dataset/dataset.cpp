@@ -1,67 +1,630 @@
 #include "dataset.h"
 
-#include <fstream>
 #include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <fstream>
+#include <new>
+#include <atomic>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "mappedfile.h"
+#include "datasetformat.h"
 #include "../misc/functions.h"
 
-Dataset::Dataset(string filename)
+Dataset::Dataset()
+{
+}
+
+Dataset::Dataset(string filename, bool verify_checksum)
+{
+	load(filename, verify_checksum, nullptr, nullptr);
+}
+
+Dataset::Dataset(string filename, Preprocessor& preprocessor, bool fit)
+{
+	ColumnStats stats;
+	load(filename, true, fit ? &preprocessor : nullptr, &stats);
+	if (_sparse)
+	{
+		cerr << "preprocessing is not applied to sparse datasets" << endl;
+		return;
+	}
+	if (fit && stats.count() != 0)
+		preprocessor.fit(stats);
+	else if (fit)
+		preprocessor.fit(*this); //binary datasets: not parsed, one extra read of the mapped data
+	preprocess(preprocessor);
+}
+
+void Dataset::load(const string& filename, bool verify_checksum, const Preprocessor* preprocessor, ColumnStats* stats)
+{
+	_file.reset(new MappedFile(filename));
+	if (!_file->isOpen())
+	{
+		cerr << "cannot open " << filename << endl;
+		return;
+	}
+	if (_file->size() >= sizeof(DatasetHeader) && memcmp(_file->data(), DATASET_MAGIC, sizeof(DATASET_MAGIC)) == 0)
+	{
+		if (!loadBinary(_file->data(), _file->size(), verify_checksum))
+			cerr << "invalid binary dataset " << filename << endl;
+		return;
+	}
+	const char* nl = static_cast<const char*>(memchr(_file->data(), '\n', _file->size()));
+	if (memchr(_file->data(), ':', (nl ? nl : _file->data() + _file->size()) - _file->data()))
+		parseSparseText(_file->data(), _file->size());
+	else
+		parseText(_file->data(), _file->size(), preprocessor, stats);
+	_file.reset();
+}
+
+Dataset::Dataset(const Dataset& source, vector<size_t> train_ids, vector<size_t> test_ids) :
+	_rows(source._rows), _n_features(source._n_features), _n_targets(source._n_targets),
+	_features(source._features), _targets(source._targets), _sparse(source._sparse), _csr(source._csr)
+{
+	for (Split& sp : _splits)
+	{
+		sp.ins = _features;
+		sp.outs = _targets;
+	}
+	_splits[TRAIN].ids = move(train_ids);
+	_splits[TEST].ids = move(test_ids);
+}
+
+void Dataset::AlignedDelete::operator()(double* p) const
+{
+	::operator delete[](p, align_val_t(DATASET_ALIGN));
+}
+
+void Dataset::allocate(size_t rows, size_t n_features, size_t n_targets)
+{
+	size_t features_size = datasetAlign(rows * n_features * sizeof(double)) / sizeof(double);
+	size_t total = features_size + rows * n_targets;
+	_storage.reset(static_cast<double*>(::operator new[](max<size_t>(total, 1) * sizeof(double), align_val_t(DATASET_ALIGN))));
+	_rows = rows;
+	_n_features = n_features;
+	_n_targets = n_targets;
+	_features = _storage.get();
+	_targets = _storage.get() + features_size;
+}
+
+//zero copy: the matrices are the blocks of the mapped file
+bool Dataset::loadBinary(const char* data, size_t size, bool verify_checksum)
+{
+	DatasetHeader h;
+	if (size < sizeof(h))
+		return false;
+	memcpy(&h, data, sizeof(h));
+	if (h.targets == 0 || !datasetHeaderValid(h, size))
+		return false;
+	size_t features_bytes = h.rows * h.features * sizeof(double);
+	size_t targets_bytes = h.rows * h.targets * sizeof(double);
+	if (verify_checksum)
+	{
+		uint64_t c = datasetChecksum(data + h.features_offset, features_bytes);
+		c = datasetChecksum(data + h.targets_offset, targets_bytes, c);
+		if (c != h.checksum)
+			return false;
+	}
+
+	_rows = h.rows;
+	_n_features = h.features;
+	_n_targets = h.targets;
+	_features = reinterpret_cast<const double*>(data + h.features_offset);
+	_targets = reinterpret_cast<const double*>(data + h.targets_offset);
+	return true;
+}
+
+bool Dataset::saveBinary(const string& filename) const
+{
+	if (_sparse)
+	{
+		cerr << "the binary format is dense, sparse datasets cannot be saved" << endl;
+		return false;
+	}
+	DatasetHeader h = {};
+	memcpy(h.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+	h.version = DATASET_VERSION;
+	h.dtype = FLOAT64;
+	h.rows = _rows;
+	h.features = _n_features;
+	h.targets = _n_targets;
+	h.features_offset = datasetAlign(sizeof(h));
+	h.targets_offset = datasetAlign(h.features_offset + h.rows * h.features * sizeof(double));
+
+	size_t features_bytes = h.rows * h.features * sizeof(double);
+	size_t targets_bytes = h.rows * h.targets * sizeof(double);
+	h.checksum = datasetChecksum(_features, features_bytes);
+	h.checksum = datasetChecksum(_targets, targets_bytes, h.checksum);
+
+	ofstream outfile(filename, ios::binary);
+	vector<char> padding(DATASET_ALIGN, 0);
+	outfile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	outfile.write(padding.data(), h.features_offset - sizeof(h));
+	outfile.write(reinterpret_cast<const char*>(_features), features_bytes);
+	outfile.write(padding.data(), h.targets_offset - h.features_offset - features_bytes);
+	outfile.write(reinterpret_cast<const char*>(_targets), targets_bytes);
+	return bool(outfile);
+}
+
+//one line: values separated by spaces, tabs or commas, the last one is the target
+static bool parseLine(const char* p, const char* end, double* values, size_t n_values)
+{
+	size_t n = 0;
+	while (true)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r'))
+			p++;
+		if (p == end)
+			return n == n_values;
+		if (n == n_values)
+			return false;
+		if (*p == '+')
+			p++;
+		auto res = from_chars(p, end, values[n]);
+		if (res.ec != errc())
+			return false;
+		p = res.ptr;
+		n++;
+	}
+}
+
+static size_t countValues(const char* p, const char* end)
 {
-	ifstream infile(filename);
-	vector<double> line;
-	double a;
-	while (!infile.eof())
+	size_t n = 0;
+	double v;
+	while (true)
 	{
-		infile >> a;
-		line.push_back(a);
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r'))
+			p++;
+		if (p == end)
+			return n;
+		if (*p == '+')
+			p++;
+		auto res = from_chars(p, end, v);
+		if (res.ec != errc())
+			return n;
+		p = res.ptr;
+		n++;
+	}
+}
+
+//Splits the text in newline aligned chunks, counts the lines of each chunk, then parses every chunk
+//on its own thread straight into its rows of the preallocated matrices
+void Dataset::parseText(const char* text, size_t size, const Preprocessor* preprocessor, ColumnStats* stats)
+{
+	const char* end = text + size;
+	size_t n_chunks = max(1u, thread::hardware_concurrency());
+	if (size < (1 << 16))
+		n_chunks = 1;
+
+	vector<const char*> bounds(n_chunks + 1, end);
+	bounds[0] = text;
+	for (size_t c = 1; c < n_chunks; c++)
+	{
+		const char* b = max(bounds[c - 1], text + size / n_chunks * c);
+		const char* nl = static_cast<const char*>(memchr(b, '\n', end - b));
+		bounds[c] = nl ? nl + 1 : end;
+	}
+
+	//PASS 1: lines per chunk (a last line without '\n' counts too)
+	vector<size_t> first_line(n_chunks + 1, 0);
+	vector<thread> t;
+	for (size_t c = 0; c < n_chunks; c++)
+		t.push_back(thread([&, c]() {
+			size_t n = count(bounds[c], bounds[c + 1], '\n');
+			if (bounds[c + 1] > bounds[c] && bounds[c + 1][-1] != '\n')
+				n++;
+			first_line[c + 1] = n;
+		}));
+	for (auto& th : t)
+		th.join();
+	t.clear();
+	for (size_t c = 0; c < n_chunks; c++)
+		first_line[c + 1] += first_line[c];
 
-		if (infile.get() == '\n')
+	//width of the data: number of values on the first non blank line
+	size_t n_values = 0;
+	for (const char* p = text; p < end && n_values == 0;)
+	{
+		const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* e = nl ? nl : end;
+		n_values = countValues(p, e);
+		p = e + 1;
+	}
+	if (n_values < 2)
+	{
+		cerr << "no data found" << endl;
+		return;
+	}
+
+	size_t n_lines = first_line[n_chunks];
+	allocate(n_lines, n_values - 1, 1);
+	double* features = _storage.get();
+	double* targets = const_cast<double*>(_targets);
+	vector<char> status(n_lines, 0); //0 ok, 1 blank, 2 malformed
+	vector<ColumnStats> chunk_stats(preprocessor ? n_chunks : 0, preprocessor ? preprocessor->newStats(_n_features) : ColumnStats());
+
+	//PASS 2: parse, each thread writes only its own rows
+	for (size_t c = 0; c < n_chunks; c++)
+		t.push_back(thread([&, c]() {
+			vector<double> values(n_values);
+			size_t line = first_line[c];
+			for (const char* p = bounds[c]; p < bounds[c + 1]; line++)
+			{
+				const char* nl = static_cast<const char*>(memchr(p, '\n', bounds[c + 1] - p));
+				const char* e = nl ? nl : bounds[c + 1];
+				const char* q = p;
+				while (q < e && (*q == ' ' || *q == '\t' || *q == ',' || *q == '\r'))
+					q++;
+				if (q == e)
+					status[line] = 1;
+				else if (!parseLine(p, e, values.data(), n_values))
+					status[line] = 2;
+				else
+				{
+					copy(values.begin(), values.end() - 1, features + line * _n_features);
+					targets[line] = values.back();
+					if (preprocessor)
+						chunk_stats[c].add(values.data());
+				}
+				p = e + 1;
+			}
+		}));
+	for (auto& th : t)
+		th.join();
+	if (preprocessor)
+	{
+		*stats = chunk_stats[0];
+		for (size_t c = 1; c < n_chunks; c++)
+			stats->merge(chunk_stats[c]);
+	}
+
+	//drop blank and malformed lines
+	size_t kept = 0;
+	for (size_t i = 0; i < n_lines; i++)
+	{
+		if (status[i] == 2)
+			_malformed_lines.push_back(i + 1);
+		if (status[i] != 0)
+			continue;
+		if (kept != i)
 		{
-			double out = line[line.size() - 1];
-			line.pop_back();
+			memcpy(features + kept * _n_features, features + i * _n_features, _n_features * sizeof(double));
+			targets[kept] = targets[i];
+		}
+		kept++;
+	}
+	_rows = kept; //the tail of the blocks stays allocated, unused
 
-			_ins.push_back(line);
-			_outs.push_back({ out });
-			line.clear();
+	if (_malformed_lines.size() != 0)
+	{
+		cerr << _malformed_lines.size() << " malformed lines skipped (line";
+		for (size_t i = 0; i < _malformed_lines.size() && i < 10; i++)
+			cerr << " " << _malformed_lines[i];
+		cerr << (_malformed_lines.size() > 10 ? " ...)" : ")") << endl;
+	}
+}
+
+static string sharedName(const string& name)
+{
+	return name.size() && name[0] == '/' ? name : "/" + name;
+}
+
+bool Dataset::publishShared(const string& name) const
+{
+#ifndef _WIN32
+	if (_sparse)
+	{
+		cerr << "the binary format is dense, sparse datasets cannot be published" << endl;
+		return false;
+	}
+	DatasetHeader h = {};
+	h.version = DATASET_VERSION;
+	h.dtype = FLOAT64;
+	h.rows = _rows;
+	h.features = _n_features;
+	h.targets = _n_targets;
+	h.features_offset = datasetAlign(sizeof(h));
+	h.targets_offset = datasetAlign(h.features_offset + h.rows * h.features * sizeof(double));
+	size_t features_bytes = h.rows * h.features * sizeof(double);
+	size_t targets_bytes = h.rows * h.targets * sizeof(double);
+	h.checksum = datasetChecksum(_features, features_bytes);
+	h.checksum = datasetChecksum(_targets, targets_bytes, h.checksum);
+	size_t size = h.targets_offset + targets_bytes;
+
+	int fd = shm_open(sharedName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0)
+	{
+		cerr << "cannot create shared memory " << name << endl;
+		return false;
+	}
+	void* p = ftruncate(fd, size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		shm_unlink(sharedName(name).c_str());
+		return false;
+	}
+
+	char* data = static_cast<char*>(p);
+	memcpy(data, &h, sizeof(h)); //magic still zero: not ready
+	memcpy(data + h.features_offset, _features, features_bytes);
+	memcpy(data + h.targets_offset, _targets, targets_bytes);
+	atomic_thread_fence(memory_order_release);
+	memcpy(data, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+	munmap(p, size);
+	return true;
+#else
+	return false;
+#endif
+}
+
+unique_ptr<Dataset> Dataset::attachShared(const string& name, bool verify_checksum)
+{
+	unique_ptr<Dataset> d(new Dataset());
+	d->_file.reset(new MappedFile(sharedName(name), true));
+	if (!d->_file->isOpen() || d->_file->size() < sizeof(DatasetHeader))
+		return nullptr;
+	if (memcmp(d->_file->data(), DATASET_MAGIC, sizeof(DATASET_MAGIC)) != 0)
+		return nullptr;
+	atomic_thread_fence(memory_order_acquire);
+	if (!d->loadBinary(d->_file->data(), d->_file->size(), verify_checksum))
+		return nullptr;
+	return d;
+}
+
+bool Dataset::unlinkShared(const string& name)
+{
+#ifndef _WIN32
+	return shm_unlink(sharedName(name).c_str()) == 0;
+#else
+	return false;
+#endif
+}
+
+//libsvm lines: target followed by index:value pairs (1-based indices, any order)
+void Dataset::parseSparseText(const char* text, size_t size)
+{
+	const char* end = text + size;
+	vector<double> targets;
+	_sparse = true;
+	_csr = make_shared<Csr>();
+	vector<size_t>& row_ptr = _csr->row_ptr;
+	vector<uint32_t>& col = _csr->col;
+	vector<double>& val = _csr->val;
+	size_t width = 0;
+	row_ptr.push_back(0);
+	size_t line = 0;
+	for (const char* p = text; p < end; )
+	{
+		const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* e = nl ? nl : end;
+		line++;
+
+		size_t first = col.size();
+		bool ok = true;
+		bool has_target = false;
+		double target = 0;
+		const char* q = p;
+		while (ok)
+		{
+			while (q < e && (*q == ' ' || *q == '\t' || *q == '\r'))
+				q++;
+			if (q == e)
+				break;
+			if (*q == '+')
+				q++;
+			if (!has_target)
+			{
+				auto res = from_chars(q, e, target);
+				ok = res.ec == errc();
+				q = res.ptr;
+				has_target = true;
+				continue;
+			}
+			uint32_t idx;
+			double v;
+			auto res = from_chars(q, e, idx);
+			ok = res.ec == errc() && res.ptr < e && *res.ptr == ':' && idx > 0;
+			if (!ok)
+				break;
+			q = res.ptr + 1;
+			auto resv = from_chars(q, e, v);
+			ok = resv.ec == errc();
+			q = resv.ptr;
+			if (ok && v != 0)
+			{
+				col.push_back(idx - 1);
+				val.push_back(v);
+				width = max<size_t>(width, idx);
+			}
 		}
+
+		if (!ok)
+		{
+			_malformed_lines.push_back(line);
+			col.resize(first);
+			val.resize(first);
+		}
+		else if (has_target)
+		{
+			targets.push_back(target);
+			row_ptr.push_back(col.size());
+		}
+		p = e + 1;
 	}
+
+	allocate(targets.size(), 0, 1);
+	_n_features = width;
+	copy(targets.begin(), targets.end(), const_cast<double*>(_targets));
+	if (_malformed_lines.size() != 0)
+		cerr << _malformed_lines.size() << " malformed lines skipped (first: line " << _malformed_lines[0] << ")" << endl;
 }
 
 Dataset::~Dataset()
 {
 }
 
+void Dataset::preprocess(const Preprocessor& preprocessor)
+{
+	if (preprocessor.inputWidth() != _n_features || _sparse)
+	{
+		cerr << "preprocessor fitted on " << preprocessor.inputWidth() << " features, dataset has " << _n_features << endl;
+		return;
+	}
+
+	size_t width = preprocessor.outputWidth();
+	bool in_place = _storage && !_file && width == _n_features;
+	const double* in = _features;
+	const double* in_targets = _targets;
+	unique_ptr<double[], AlignedDelete> old_storage;
+	unique_ptr<MappedFile> old_file;
+	if (!in_place)
+	{
+		old_storage = move(_storage);
+		old_file = move(_file);
+		allocate(_rows, width, _n_targets);
+		memcpy(const_cast<double*>(_targets), in_targets, _rows * _n_targets * sizeof(double));
+	}
+	else
+		_n_features = width;
+
+	size_t in_width = preprocessor.inputWidth();
+	double* out = _storage.get();
+	size_t n_chunks = max(1u, thread::hardware_concurrency());
+	vector<thread> t;
+	for (size_t c = 0; c < n_chunks; c++)
+		t.push_back(thread([&, c]() {
+			for (size_t i = _rows * c / n_chunks; i < _rows * (c + 1) / n_chunks; i++)
+				preprocessor.transform(in + i * in_width, out + i * width);
+		}));
+	for (auto& th : t)
+		th.join();
+
+	for (Split& sp : _splits)
+	{
+		sp.ins = _features;
+		sp.outs = _targets;
+	}
+}
+
 void Dataset::split(double ptrain)
 {
-	for (size_t i = 0; i < _ins.size(); i++)
+	for (Split& sp : _splits)
+	{
+		sp.ins = _features;
+		sp.outs = _targets;
+		sp.ids.clear();
+	}
+	for (size_t i = 0; i < _rows; i++)
 	{
 		if (random(0, 1) < ptrain)
-		{
-			_train_ins.push_back(&_ins[i]);
-			_train_outs.push_back(&_outs[i]);
-		}
+			_splits[TRAIN].ids.push_back(i);
 		else
-		{
-			_test_ins.push_back(&_ins[i]);
-			_test_outs.push_back(&_outs[i]);
-		}
+			_splits[TEST].ids.push_back(i);
+	}
+}
+
+
+void Dataset::getBatch(Datatype d, size_t n, vector<Row>& ins, vector<Row>& outs)
+{
+	if (_sparse)
+	{
+		cerr << "getBatch on a sparse dataset, use getSparseBatch" << endl;
+		ins.clear();
+		outs.clear();
+		return;
 	}
+	RowView in = getIns(d);
+	RowView out = getOuts(d);
+	ins.resize(n);
+	outs.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		int z = rand() % in.size();
+		ins[i] = in[z];
+		outs[i] = out[z];
+	}
+}
+
+void Dataset::getSparseBatch(Datatype d, size_t n, vector<SparseRow>& ins, vector<Row>& outs)
+{
+	SparseRowView in = getSparseIns(d);
+	RowView out = getOuts(d);
+	ins.resize(n);
+	outs.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		int z = rand() % in.size();
+		ins[i] = in[z];
+		outs[i] = out[z];
+	}
+}
+
+bool Dataset::isSparse() const
+{
+	return _sparse;
 }
 
+SparseRowView Dataset::getSparseIns(Datatype d) const
+{
+	if (!_csr)
+		return SparseRowView();
+	const Split& sp = _splits[d];
+	return SparseRowView(_csr->row_ptr.data(), _csr->col.data(), _csr->val.data(), _n_features, sp.ids.data(), sp.ids.size());
+}
+
+const vector<size_t>& Dataset::getMalformedLines() const
+{
+	return _malformed_lines;
+}
 
-const vector<const vector<double>*>& Dataset::getIns(Datatype d) const
+//sparse datasets have no dense features: an empty view, so that a caller that did not check isSparse reads nothing
+RowView Dataset::getIns(Datatype d) const
 { 
-	if(d == Datatype::TRAIN)
-		return _train_ins;
-	return _test_ins;
+	const Split& sp = _splits[d];
+	if (_sparse)
+	{
+		cerr << "getIns on a sparse dataset, use getSparseIns" << endl;
+		return RowView();
+	}
+	return RowView(sp.ins, _n_features, sp.ids.data(), sp.ids.size());
 }
 
-const vector<const vector<double>*>& Dataset::getOuts(Datatype d) const
+RowView Dataset::getOuts(Datatype d) const
 {
-	if (d == Datatype::TRAIN)
-		return _train_outs;
-	return _test_outs;
+	const Split& sp = _splits[d];
+	return RowView(sp.outs, _n_targets, sp.ids.data(), sp.ids.size());
 }
 
+size_t Dataset::size() const
+{
+	return _rows;
+}
 
+size_t Dataset::featureCount() const
+{
+	return _n_features;
+}
 
+size_t Dataset::targetCount() const
+{
+	return _n_targets;
+}
 
+const double* Dataset::features() const
+{
+	return _features;
+}
+
+const double* Dataset::targets() const
+{
+	return _targets;
+}
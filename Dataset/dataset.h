@@ -1,6 +1,10 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <memory>
+#include "row.h"
+#include "preprocessing.h"
 
 using namespace std;
 
@@ -9,25 +13,114 @@ enum Datatype {
 	TEST
 };
 
+class MappedFile;
+
+//Samples are stored as one aligned row-major feature matrix and one target matrix,
+//the TRAIN and TEST splits are index arrays into them.
+//Sparse datasets (libsvm text: "target index:value ...", 1-based indices) keep the features as a CSR matrix
+//instead, read them with getSparseIns / getSparseBatch (getIns / getBatch report the error and return nothing).
 class Dataset
 {
 public:
-	Dataset(string filename);
-	~Dataset();
+	//text (one sample per line, target last) or binary (see datasetformat.h), detected from the content
+	Dataset(string filename, bool verify_checksum = true);
+
+	//Loads and preprocesses in the same pass: when fit is true the column statistics are gathered by the parser
+	//threads and preprocessor is fitted on them, then the transform is applied to the samples
+	Dataset(string filename, Preprocessor& preprocessor, bool fit = true);
+
+	//Another split of the same samples: shares source's storage (source must outlive it), only the index arrays are new
+	Dataset(const Dataset& source, vector<size_t> train_ids, vector<size_t> test_ids);
+	virtual ~Dataset();
+
+	RowView getIns(Datatype d) const;
+
+	RowView getOuts(Datatype d) const;
+
+	virtual void split(double ptrain);
+
+	//applies a fitted transform to every sample, in place when the width does not change
+	void preprocess(const Preprocessor& preprocessor);
+
+	//n random samples of d (rows stay valid until the next call), this is how the optimizers read batches
+	virtual void getBatch(Datatype d, size_t n, vector<Row>& ins, vector<Row>& outs);
+
+	//writes every sample (not only a split) in the binary format
+	bool saveBinary(const string& filename) const;
+
+	//Publishes every sample in a named POSIX shared memory object, in the binary format. The magic is written
+	//last, so attachShared never sees a half written segment.
+	bool publishShared(const string& name) const;
+
+	//Read-only dataset over a published segment, zero copy (nullptr if it does not exist or is not ready)
+	static unique_ptr<Dataset> attachShared(const string& name, bool verify_checksum = false);
+
+	static bool unlinkShared(const string& name);
+
+	//1-based line numbers of the lines rejected by the parser
+	const vector<size_t>& getMalformedLines() const;
+
+	size_t size() const;
+
+	size_t featureCount() const;
+
+	size_t targetCount() const;
+
+	const double* features() const;
+
+	bool isSparse() const;
+
+	SparseRowView getSparseIns(Datatype d) const;
+
+	void getSparseBatch(Datatype d, size_t n, vector<SparseRow>& ins, vector<Row>& outs);
+
+	const double* targets() const;
+
+protected:
+	Dataset();
+
+	void load(const string& filename, bool verify_checksum, const Preprocessor* preprocessor, ColumnStats* stats);
+
+	void parseText(const char* text, size_t size, const Preprocessor* preprocessor = nullptr, ColumnStats* stats = nullptr);
+
+	bool loadBinary(const char* data, size_t size, bool verify_checksum);
+
+	void parseSparseText(const char* text, size_t size);
+
+	//owned storage for rows x features then rows x targets, both blocks 64-byte aligned
+	void allocate(size_t rows, size_t n_features, size_t n_targets);
 
-	const vector<const vector<double>*>& getIns(Datatype d) const;
+	struct AlignedDelete
+	{
+		void operator()(double* p) const;
+	};
 
-	const vector<const vector<double>*>& getOuts(Datatype d) const;
+	struct Split
+	{
+		const double* ins = nullptr;
+		const double* outs = nullptr;
+		vector<size_t> ids;
+	};
 
-	void split(double ptrain);
+	unique_ptr<double[], AlignedDelete> _storage;
+	unique_ptr<MappedFile> _file; //binary datasets are used in place, straight from the mapping
+	size_t _rows = 0;
+	size_t _n_features = 0;
+	size_t _n_targets = 0;
+	const double* _features = nullptr;
+	const double* _targets = nullptr;
 
-private:
-	vector<vector<double> > _ins;
-	vector<vector<double> > _outs;
+	Split _splits[2]; //indexed by Datatype
 
-	vector<const vector<double>*> _train_ins;
-	vector<const vector<double>*> _train_outs;
+	//CSR features of sparse datasets, shared with the fold datasets
+	struct Csr
+	{
+		vector<size_t> row_ptr;
+		vector<uint32_t> col;
+		vector<double> val;
+	};
+	bool _sparse = false;
+	shared_ptr<Csr> _csr;
 
-	vector<const vector<double>*> _test_ins;
-	vector<const vector<double>*> _test_outs;
+	vector<size_t> _malformed_lines;
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+//Binary dataset file (little endian):
+//  header (64 bytes)
+//  features: rows x features doubles, row major, starting at features_offset (64-byte aligned)
+//  targets: rows x targets doubles, row major, starting at targets_offset (64-byte aligned)
+
+#define DATASET_MAGIC "NNDSET1"
+#define DATASET_VERSION 1
+#define DATASET_ALIGN 64
+
+enum DatasetDtype
+{
+	FLOAT64 = 0
+};
+
+struct DatasetHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t dtype;
+	uint64_t rows;
+	uint64_t features;
+	uint64_t targets;
+	uint64_t features_offset;
+	uint64_t targets_offset;
+	uint64_t checksum; //datasetChecksum of the feature block followed by the target block
+};
+
+static_assert(sizeof(DatasetHeader) == 64, "DatasetHeader must stay 64 bytes");
+
+//64-bit multiplicative hash over whole words (the blocks are multiples of 8 bytes)
+inline uint64_t datasetChecksum(const void* data, size_t bytes, uint64_t h = 1469598103934665603ull)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i + 8 <= bytes; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 1099511628211ull;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+inline uint64_t datasetAlign(uint64_t offset)
+{
+	return (offset + DATASET_ALIGN - 1) / DATASET_ALIGN * DATASET_ALIGN;
+}
+
+//Checks an untrusted header (magic apart) against the size of its file: known version and dtype, no overflow in the
+//block sizes, blocks aligned, after the header and inside the file
+inline bool datasetHeaderValid(const DatasetHeader& h, size_t size)
+{
+	if (size < sizeof(h) || h.version != DATASET_VERSION || h.dtype != FLOAT64)
+		return false;
+	const uint64_t max_values = SIZE_MAX / sizeof(double);
+	if (h.rows > max_values || (h.features && h.rows > max_values / h.features) || (h.targets && h.rows > max_values / h.targets))
+		return false;
+	uint64_t features_bytes = h.rows * h.features * sizeof(double);
+	uint64_t targets_bytes = h.rows * h.targets * sizeof(double);
+	return h.features_offset >= sizeof(h) && h.targets_offset >= sizeof(h)
+		&& h.features_offset % sizeof(double) == 0 && h.targets_offset % sizeof(double) == 0
+		&& h.features_offset <= size && features_bytes <= size - h.features_offset
+		&& h.targets_offset <= size && targets_bytes <= size - h.targets_offset;
+}
@@ -0,0 +1,69 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const string& filename, bool shared_memory)
+{
+#ifndef _WIN32
+	int fd = shared_memory ? shm_open(filename.c_str(), O_RDONLY, 0) : open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED)
+		{
+			madvise(p, st.st_size, MADV_SEQUENTIAL);
+			_data = static_cast<const char*>(p);
+			_size = st.st_size;
+			_mapped = true;
+			_open = true;
+		}
+	}
+	close(fd);
+	if (_mapped || shared_memory)
+		return;
+#else
+	if (shared_memory)
+		return;
+#endif
+	//empty files, pipes, or no mmap: read everything
+	ifstream infile(filename, ios::binary);
+	if (!infile)
+		return;
+	_buffer.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+	_data = _buffer.data();
+	_size = _buffer.size();
+	_open = true;
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+	if (_mapped)
+		munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+bool MappedFile::isOpen() const
+{
+	return _open;
+}
+
+const char* MappedFile::data() const
+{
+	return _data;
+}
+
+size_t MappedFile::size() const
+{
+	return _size;
+}
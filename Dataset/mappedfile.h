@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Read-only view of a whole file, memory mapped where the platform allows it.
+//With shared_memory, filename is the name of a POSIX shared memory object instead (shm_open)
+class MappedFile
+{
+public:
+	MappedFile(const string& filename, bool shared_memory = false);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool isOpen() const;
+
+	const char* data() const;
+
+	size_t size() const;
+
+private:
+	const char* _data = nullptr;
+	size_t _size = 0;
+	bool _open = false;
+	bool _mapped = false;
+	vector<char> _buffer; //fallback when mmap is not available
+};
@@ -0,0 +1,232 @@
+#include "preprocessing.h"
+#include "dataset.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+
+ColumnStats::ColumnStats(size_t width, const vector<size_t>& categorical) :
+	_mean(width, 0), _m2(width, 0), _min(width, numeric_limits<double>::max()), _max(width, -numeric_limits<double>::max()),
+	_categorical(categorical), _categories(width)
+{
+}
+
+void ColumnStats::add(const double* row)
+{
+	_n++;
+	for (size_t j = 0; j < _mean.size(); j++)
+	{
+		double d = row[j] - _mean[j];
+		_mean[j] += d / _n;
+		_m2[j] += d * (row[j] - _mean[j]);
+		_min[j] = std::min(_min[j], row[j]);
+		_max[j] = std::max(_max[j], row[j]);
+	}
+	for (size_t j : _categorical)
+		_categories[j].insert(row[j]);
+}
+
+void ColumnStats::merge(const ColumnStats& other)
+{
+	if (other._n == 0)
+		return;
+	size_t n = _n + other._n;
+	for (size_t j = 0; j < _mean.size(); j++)
+	{
+		double d = other._mean[j] - _mean[j];
+		_mean[j] += d * other._n / n;
+		_m2[j] += other._m2[j] + d * d * double(_n) * other._n / n;
+		_min[j] = std::min(_min[j], other._min[j]);
+		_max[j] = std::max(_max[j], other._max[j]);
+	}
+	for (size_t j : _categorical)
+		_categories[j].insert(other._categories[j].begin(), other._categories[j].end());
+	_n = n;
+}
+
+size_t ColumnStats::count() const
+{
+	return _n;
+}
+
+size_t ColumnStats::width() const
+{
+	return _mean.size();
+}
+
+double ColumnStats::mean(size_t j) const
+{
+	return _mean[j];
+}
+
+double ColumnStats::variance(size_t j) const
+{
+	return _n > 1 ? _m2[j] / (_n - 1) : 0;
+}
+
+double ColumnStats::min(size_t j) const
+{
+	return _min[j];
+}
+
+double ColumnStats::max(size_t j) const
+{
+	return _max[j];
+}
+
+const set<double>& ColumnStats::categories(size_t j) const
+{
+	return _categories[j];
+}
+
+
+Preprocessor::Preprocessor()
+{
+}
+
+void Preprocessor::setScaling(Scaling scaling)
+{
+	_scaling = scaling;
+}
+
+void Preprocessor::setClip(double clip)
+{
+	_clip = clip;
+}
+
+void Preprocessor::setOneHot(const vector<size_t>& columns)
+{
+	_one_hot = columns;
+}
+
+ColumnStats Preprocessor::newStats(size_t width) const
+{
+	return ColumnStats(width, _one_hot);
+}
+
+void Preprocessor::fit(const ColumnStats& stats)
+{
+	size_t width = stats.width();
+	_offset.assign(width, 0);
+	_scale.assign(width, 1);
+	_categories.assign(width, vector<double>());
+	_output_width = 0;
+	for (size_t j = 0; j < width; j++)
+	{
+		if (find(_one_hot.begin(), _one_hot.end(), j) != _one_hot.end())
+		{
+			_categories[j].assign(stats.categories(j).begin(), stats.categories(j).end());
+			_output_width += _categories[j].size();
+			continue;
+		}
+		if (_scaling == STANDARD_SCALING && stats.variance(j) > 0)
+		{
+			_offset[j] = stats.mean(j);
+			_scale[j] = 1 / sqrt(stats.variance(j));
+		}
+		if (_scaling == MINMAX_SCALING && stats.max(j) > stats.min(j))
+		{
+			_offset[j] = stats.min(j);
+			_scale[j] = 1 / (stats.max(j) - stats.min(j));
+		}
+		_output_width++;
+	}
+}
+
+void Preprocessor::fit(const Dataset& data)
+{
+	size_t n_chunks = max(1u, thread::hardware_concurrency());
+	size_t width = data.featureCount();
+	vector<ColumnStats> stats(n_chunks, newStats(width));
+	vector<thread> t;
+	for (size_t c = 0; c < n_chunks; c++)
+		t.push_back(thread([&, c]() {
+			for (size_t i = data.size() * c / n_chunks; i < data.size() * (c + 1) / n_chunks; i++)
+				stats[c].add(data.features() + i * width);
+		}));
+	for (size_t c = 0; c < n_chunks; c++)
+	{
+		t[c].join();
+		if (c > 0)
+			stats[0].merge(stats[c]);
+	}
+	fit(stats[0]);
+}
+
+size_t Preprocessor::inputWidth() const
+{
+	return _offset.size();
+}
+
+size_t Preprocessor::outputWidth() const
+{
+	return _output_width;
+}
+
+void Preprocessor::transform(const double* in, double* out) const
+{
+	for (size_t j = 0; j < _offset.size(); j++)
+	{
+		if (_categories[j].size() != 0)
+		{
+			for (double c : _categories[j])
+				*out++ = in[j] == c ? 1 : 0;
+			continue;
+		}
+		double v = (in[j] - _offset[j]) * _scale[j];
+		if (_clip > 0)
+			v = std::min(_clip, std::max(-_clip, v));
+		*out++ = v;
+	}
+}
+
+vector<double> Preprocessor::transform(const Row& in) const
+{
+	vector<double> out(_output_width);
+	transform(in.data(), out.data());
+	return out;
+}
+
+//text: a header line, then per input column: offset scale n_categories categories...
+bool Preprocessor::save(const string& filename) const
+{
+	ofstream outfile(filename);
+	outfile.precision(17);
+	outfile << "preprocessor " << int(_scaling) << " " << _clip << " " << _offset.size() << " " << _output_width << "\n";
+	for (size_t j = 0; j < _offset.size(); j++)
+	{
+		outfile << _offset[j] << " " << _scale[j] << " " << _categories[j].size();
+		for (double c : _categories[j])
+			outfile << " " << c;
+		outfile << "\n";
+	}
+	return bool(outfile);
+}
+
+bool Preprocessor::load(const string& filename)
+{
+	ifstream infile(filename);
+	string tag;
+	int scaling;
+	size_t width;
+	if (!(infile >> tag >> scaling >> _clip >> width >> _output_width) || tag != "preprocessor")
+		return false;
+	_scaling = Scaling(scaling);
+	_offset.resize(width);
+	_scale.resize(width);
+	_categories.assign(width, vector<double>());
+	_one_hot.clear();
+	for (size_t j = 0; j < width; j++)
+	{
+		size_t n;
+		infile >> _offset[j] >> _scale[j] >> n;
+		_categories[j].resize(n);
+		for (size_t k = 0; k < n; k++)
+			infile >> _categories[j][k];
+		if (n != 0)
+			_one_hot.push_back(j);
+	}
+	return bool(infile);
+}
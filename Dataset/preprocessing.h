@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <set>
+#include <string>
+#include "row.h"
+
+using namespace std;
+
+class Dataset;
+
+//Running statistics of the feature columns (Welford), mergeable across chunks (Chan et al.)
+class ColumnStats
+{
+public:
+	ColumnStats(size_t width = 0, const vector<size_t>& categorical = {});
+
+	void add(const double* row);
+
+	void merge(const ColumnStats& other);
+
+	size_t count() const;
+
+	size_t width() const;
+
+	double mean(size_t j) const;
+
+	double variance(size_t j) const;
+
+	double min(size_t j) const;
+
+	double max(size_t j) const;
+
+	const set<double>& categories(size_t j) const;
+
+private:
+	size_t _n = 0;
+	vector<double> _mean;
+	vector<double> _m2;
+	vector<double> _min;
+	vector<double> _max;
+	vector<size_t> _categorical;
+	vector<set<double> > _categories; //distinct values, categorical columns only
+};
+
+enum Scaling
+{
+	NO_SCALING = 0,
+	STANDARD_SCALING, //(x - mean) / std
+	MINMAX_SCALING //(x - min) / (max - min)
+};
+
+//Feature preprocessing fitted on the data: scaling, clipping of the scaled values to [-clip, clip],
+//and one-hot expansion of categorical columns (one output per distinct value seen, unknown values give all zeros).
+//The fitted transform can be saved and loaded to be applied again at inference.
+class Preprocessor
+{
+public:
+	Preprocessor();
+
+	void setScaling(Scaling scaling);
+
+	void setClip(double clip); //0 disables clipping
+
+	void setOneHot(const vector<size_t>& columns);
+
+	ColumnStats newStats(size_t width) const;
+
+	void fit(const ColumnStats& stats);
+
+	//statistics computed on parallel chunks of the samples
+	void fit(const Dataset& data);
+
+	size_t inputWidth() const;
+
+	size_t outputWidth() const;
+
+	void transform(const double* in, double* out) const;
+
+	vector<double> transform(const Row& in) const;
+
+	bool save(const string& filename) const;
+
+	bool load(const string& filename);
+
+private:
+	Scaling _scaling = STANDARD_SCALING;
+	double _clip = 0;
+	vector<size_t> _one_hot;
+
+	//fitted, per input column
+	vector<double> _offset;
+	vector<double> _scale;
+	vector<vector<double> > _categories;
+	size_t _output_width = 0;
+};
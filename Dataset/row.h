@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+//One sample (or its target): a view on n contiguous values, no ownership
+class Row
+{
+public:
+	Row() {}
+	Row(const double* p, size_t n) : _p(p), _n(n) {}
+	Row(const vector<double>& v) : _p(v.data()), _n(v.size()) {}
+
+	size_t size() const { return _n; }
+	const double* data() const { return _p; }
+	double operator[](size_t i) const { return _p[i]; }
+	const double* begin() const { return _p; }
+	const double* end() const { return _p + _n; }
+
+private:
+	const double* _p = nullptr;
+	size_t _n = 0;
+};
+
+//The samples of a split: rows of a row-major matrix selected by an index array
+class RowView
+{
+public:
+	RowView() {}
+	RowView(const double* base, size_t width, const size_t* ids, size_t n) : _base(base), _width(width), _ids(ids), _n(n) {}
+
+	size_t size() const { return _n; }
+	size_t width() const { return _width; }
+	size_t id(size_t i) const { return _ids[i]; } //row in the matrix
+	Row operator[](size_t i) const { return Row(_base + _ids[i] * _width, _width); }
+
+private:
+	const double* _base = nullptr;
+	size_t _width = 0;
+	const size_t* _ids = nullptr;
+	size_t _n = 0;
+};
+
+//One sparse sample: nnz (index, value) pairs out of width features
+class SparseRow
+{
+public:
+	SparseRow() {}
+	SparseRow(const uint32_t* idx, const double* val, size_t nnz, size_t width) : _idx(idx), _val(val), _nnz(nnz), _width(width) {}
+
+	size_t nnz() const { return _nnz; }
+	size_t width() const { return _width; }
+	const uint32_t* indices() const { return _idx; }
+	const double* values() const { return _val; }
+
+private:
+	const uint32_t* _idx = nullptr;
+	const double* _val = nullptr;
+	size_t _nnz = 0;
+	size_t _width = 0;
+};
+
+//The samples of a split of a CSR matrix, selected by an index array
+class SparseRowView
+{
+public:
+	SparseRowView() {}
+	SparseRowView(const size_t* row_ptr, const uint32_t* col, const double* val, size_t width, const size_t* ids, size_t n) :
+		_row_ptr(row_ptr), _col(col), _val(val), _width(width), _ids(ids), _n(n) {}
+
+	size_t size() const { return _n; }
+	SparseRow operator[](size_t i) const
+	{
+		size_t r = _ids[i];
+		return SparseRow(_col + _row_ptr[r], _val + _row_ptr[r], _row_ptr[r + 1] - _row_ptr[r], _width);
+	}
+
+private:
+	const size_t* _row_ptr = nullptr;
+	const uint32_t* _col = nullptr;
+	const double* _val = nullptr;
+	size_t _width = 0;
+	const size_t* _ids = nullptr;
+	size_t _n = 0;
+};
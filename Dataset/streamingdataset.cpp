@@ -0,0 +1,192 @@
+#include "streamingdataset.h"
+#include "datasetformat.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+
+StreamingDataset::StreamingDataset(string filename, size_t test_rows, size_t shard_rows, size_t n_buffers, size_t shuffle_window) :
+	_stream(filename, ios::binary), _test_rows(test_rows), _shard_rows(shard_rows), _n_buffers(n_buffers), _shuffle_window(shuffle_window)
+{
+	DatasetHeader h;
+	if (!_stream.read(reinterpret_cast<char*>(&h), sizeof(h)) || memcmp(h.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC)) != 0
+		|| h.version != DATASET_VERSION || h.dtype != FLOAT64 || h.rows <= test_rows)
+	{
+		cerr << "cannot stream " << filename << " (binary dataset with more than " << test_rows << " rows expected)" << endl;
+		return;
+	}
+	_open = true;
+	_file_rows = h.rows;
+	_features_offset = h.features_offset;
+	_targets_offset = h.targets_offset;
+	_n_features = h.features;
+	_n_targets = h.targets;
+	start();
+}
+
+StreamingDataset::~StreamingDataset()
+{
+	stop();
+}
+
+bool StreamingDataset::isOpen() const
+{
+	return _open;
+}
+
+//loads the TEST rows, then starts the io thread and fills the shuffle window from the first TRAIN row
+void StreamingDataset::start()
+{
+	//TEST set, in memory
+	allocate(_test_rows, _n_features, _n_targets);
+	readRows(0, _test_rows, _storage.get(), const_cast<double*>(_targets));
+	_splits[TEST].ins = _features;
+	_splits[TEST].outs = _targets;
+	_splits[TEST].ids.clear();
+	for (size_t i = 0; i < _test_rows; i++)
+		_splits[TEST].ids.push_back(i);
+
+	//ring buffers, locked in memory when allowed so the io thread never waits on the pager
+	_ring.assign(max<size_t>(_n_buffers, 2), Shard());
+	for (Shard& s : _ring)
+	{
+		s.features.resize(_shard_rows * _n_features);
+		s.targets.resize(_shard_rows * _n_targets);
+#ifndef _WIN32
+		mlock(s.features.data(), s.features.size() * sizeof(double));
+		mlock(s.targets.data(), s.targets.size() * sizeof(double));
+#endif
+	}
+	_ring_read = _ring_write = _ring_count = _cursor = 0;
+	_stop = false;
+	_io = thread(&StreamingDataset::ioLoop, this);
+
+	//fill the shuffle window, it is the TRAIN split
+	_window = min(_shuffle_window, _file_rows - _test_rows);
+	_window_ins.resize(_window * _n_features);
+	_window_outs.resize(_window * _n_targets);
+	_splits[TRAIN].ids.clear();
+	for (size_t i = 0; i < _window; i++)
+	{
+		nextRow(&_window_ins[i * _n_features], &_window_outs[i * _n_targets]);
+		_splits[TRAIN].ids.push_back(i);
+	}
+	_splits[TRAIN].ins = _window_ins.data();
+	_splits[TRAIN].outs = _window_outs.data();
+}
+
+void StreamingDataset::stop()
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	if (_io.joinable())
+		_io.join();
+}
+
+//the TEST set is the first (1 - ptrain) of the file (at least one row of each split), the stream restarts after it
+void StreamingDataset::split(double ptrain)
+{
+	if (!_open)
+		return;
+	size_t test_rows = size_t((1 - min(max(ptrain, 0.0), 1.0)) * _file_rows + 0.5);
+	test_rows = min(max<size_t>(test_rows, 1), _file_rows - 1);
+	stop();
+	_test_rows = test_rows;
+	start();
+}
+
+void StreamingDataset::readRows(size_t first, size_t n, double* features, double* targets)
+{
+	_stream.clear();
+	_stream.seekg(_features_offset + first * _n_features * sizeof(double));
+	_stream.read(reinterpret_cast<char*>(features), n * _n_features * sizeof(double));
+	_stream.seekg(_targets_offset + first * _n_targets * sizeof(double));
+	_stream.read(reinterpret_cast<char*>(targets), n * _n_targets * sizeof(double));
+}
+
+//reads the TRAIN rows shard after shard, looping over the file, as long as a buffer is free
+void StreamingDataset::ioLoop()
+{
+	size_t row = _test_rows;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(_mutex);
+			_cv.wait(lock, [&]() { return _stop || _ring_count < _ring.size(); });
+			if (_stop)
+				return;
+		}
+
+		//the consumer never touches a buffer that is not counted yet, no lock needed to fill it
+		Shard& s = _ring[_ring_write];
+		s.rows = min(_shard_rows, _file_rows - row);
+		readRows(row, s.rows, s.features.data(), s.targets.data());
+		row += s.rows;
+		if (row == _file_rows)
+			row = _test_rows;
+
+		{
+			lock_guard<mutex> lock(_mutex);
+			_ring_write = (_ring_write + 1) % _ring.size();
+			_ring_count++;
+		}
+		_cv.notify_all();
+	}
+}
+
+void StreamingDataset::nextRow(double* in, double* out)
+{
+	unique_lock<mutex> lock(_mutex);
+	if (_ring_count > 0 && _cursor == _ring[_ring_read].rows)
+	{
+		//shard consumed, hand the buffer back to the io thread
+		_ring_read = (_ring_read + 1) % _ring.size();
+		_ring_count--;
+		_cursor = 0;
+		_cv.notify_all();
+	}
+	_cv.wait(lock, [&]() { return _ring_count > 0; });
+	lock.unlock();
+
+	const Shard& s = _ring[_ring_read];
+	memcpy(in, &s.features[_cursor * _n_features], _n_features * sizeof(double));
+	memcpy(out, &s.targets[_cursor * _n_targets], _n_targets * sizeof(double));
+	_cursor++;
+}
+
+//TRAIN: draw from the shuffle window and replace every drawn sample by the next one of the stream
+void StreamingDataset::getBatch(Datatype d, size_t n, vector<Row>& ins, vector<Row>& outs)
+{
+	if (d == TEST)
+	{
+		Dataset::getBatch(d, n, ins, outs);
+		return;
+	}
+	if (_window == 0) //not open, or no shuffle window
+	{
+		ins.clear();
+		outs.clear();
+		return;
+	}
+	_batch_ins.resize(n * _n_features);
+	_batch_outs.resize(n * _n_targets);
+	ins.resize(n);
+	outs.resize(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t z = rand() % _window;
+		double* in = &_batch_ins[i * _n_features];
+		double* out = &_batch_outs[i * _n_targets];
+		memcpy(in, &_window_ins[z * _n_features], _n_features * sizeof(double));
+		memcpy(out, &_window_outs[z * _n_targets], _n_targets * sizeof(double));
+		nextRow(&_window_ins[z * _n_features], &_window_outs[z * _n_targets]);
+		ins[i] = Row(in, _n_features);
+		outs[i] = Row(out, _n_targets);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "dataset.h"
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Out-of-core dataset over a binary dataset file (see datasetformat.h).
+//The first test_rows samples (or the share given to split) are kept in memory as the TEST set. The TRAIN samples
+//are streamed from disk in shards by a background thread into a ring of buffers, and batches are drawn from a
+//shuffle window over the stream.
+//getIns(TRAIN) / getOuts(TRAIN) give the current shuffle window.
+class StreamingDataset : public Dataset
+{
+public:
+	StreamingDataset(string filename, size_t test_rows = 1000, size_t shard_rows = 65536, size_t n_buffers = 3, size_t shuffle_window = 100000);
+	~StreamingDataset();
+
+	//moves the TRAIN / TEST boundary to ptrain of the file and restarts the stream, the TEST rows are held in memory
+	void split(double ptrain);
+
+	void getBatch(Datatype d, size_t n, vector<Row>& ins, vector<Row>& outs);
+
+	bool isOpen() const;
+
+private:
+	struct Shard
+	{
+		vector<double> features;
+		vector<double> targets;
+		size_t rows = 0;
+	};
+
+	void start();
+
+	void stop();
+
+	void ioLoop();
+
+	void readRows(size_t first, size_t n, double* features, double* targets);
+
+	void nextRow(double* in, double* out);
+
+	ifstream _stream;
+	bool _open = false;
+	size_t _file_rows = 0;
+	size_t _features_offset = 0, _targets_offset = 0;
+	size_t _test_rows;
+	size_t _shard_rows;
+	size_t _n_buffers;
+	size_t _shuffle_window;
+
+	//ring of shards, filled by the io thread
+	vector<Shard> _ring;
+	size_t _ring_read = 0, _ring_write = 0, _ring_count = 0;
+	size_t _cursor = 0; //next row in _ring[_ring_read]
+	bool _stop = false;
+	mutex _mutex;
+	condition_variable _cv;
+	thread _io;
+
+	//shuffle window and the storage of the last batch
+	size_t _window = 0;
+	vector<double> _window_ins;
+	vector<double> _window_outs;
+	vector<double> _batch_ins;
+	vector<double> _batch_outs;
+};
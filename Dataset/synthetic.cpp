@@ -0,0 +1,120 @@
+#include "synthetic.h"
+#include "datasetformat.h"
+#include <fstream>
+#include <random>
+#include <vector>
+#include <cstdio>
+
+
+//label of a row, a pure function of (seed, row) so that it can be computed again without the features
+static int rowLabel(uint64_t seed, uint64_t row)
+{
+	uint64_t z = seed * 0x9E3779B97F4A7C15ull + row + 1; //splitmix64
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return int((z ^ (z >> 31)) & 1);
+}
+
+static void generateRow(mt19937_64& gen, int label, size_t features, size_t informative, double separation, double* out)
+{
+	normal_distribution<double> rnorm(0, 1);
+	//moments of data1000.txt: class 0 around (-1, 0), class 1 around (1, 1)
+	static const double mean[2][2] = { { -1, 0 }, { 1, 1 } };
+	static const double sd[2][2] = { { 0.8, 0.5 }, { 0.5, 0.8 } };
+	for (size_t j = 0; j < features; j++)
+	{
+		double z = rnorm(gen);
+		if (j < 2 && j < informative)
+			out[j] = mean[label][j] + sd[label][j] * z;
+		else if (j < informative)
+			out[j] = z + (label ? separation : -separation) / 2;
+		else
+			out[j] = z;
+	}
+}
+
+bool generateDataset(const string& filename, unordered_map<string, double> parameters, bool binary)
+{
+	size_t rows = parameters.count("rows") ? size_t(parameters["rows"]) : 1000;
+	size_t features = parameters.count("features") ? size_t(parameters["features"]) : 2;
+	size_t informative = parameters.count("informative") ? size_t(parameters["informative"]) : 2;
+	double separation = parameters.count("separation") ? parameters["separation"] : 2;
+	uint64_t seed = parameters.count("seed") ? uint64_t(parameters["seed"]) : 0;
+
+	ofstream outfile(filename, ios::binary);
+	if (!outfile)
+		return false;
+	mt19937_64 gen(seed);
+	vector<double> row(features);
+	const size_t block = 4096; //rows per write
+
+	if (!binary)
+	{
+		string text;
+		char buf[32];
+		for (size_t i = 0; i < rows; i++)
+		{
+			int label = rowLabel(seed, i);
+			generateRow(gen, label, features, informative, separation, row.data());
+			for (size_t j = 0; j < features; j++)
+			{
+				snprintf(buf, sizeof(buf), "%.17g\t", row[j]);
+				text += buf;
+			}
+			text += label ? "1\n" : "0\n";
+			if (i % block == block - 1)
+			{
+				outfile << text;
+				text.clear();
+			}
+		}
+		outfile << text;
+		return bool(outfile);
+	}
+
+	DatasetHeader h = {};
+	memcpy(h.magic, DATASET_MAGIC, sizeof(DATASET_MAGIC));
+	h.version = DATASET_VERSION;
+	h.dtype = FLOAT64;
+	h.rows = rows;
+	h.features = features;
+	h.targets = 1;
+	h.features_offset = datasetAlign(sizeof(h));
+	h.targets_offset = datasetAlign(h.features_offset + rows * features * sizeof(double));
+
+	//features block, checksummed while it is written
+	vector<char> padding(DATASET_ALIGN, 0);
+	outfile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	outfile.write(padding.data(), h.features_offset - sizeof(h));
+	vector<double> buffer;
+	uint64_t checksum = datasetChecksum(nullptr, 0);
+	for (size_t i = 0; i < rows; i++)
+	{
+		generateRow(gen, rowLabel(seed, i), features, informative, separation, row.data());
+		buffer.insert(buffer.end(), row.begin(), row.end());
+		if (i % block == block - 1 || i == rows - 1)
+		{
+			checksum = datasetChecksum(buffer.data(), buffer.size() * sizeof(double), checksum);
+			outfile.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(double));
+			buffer.clear();
+		}
+	}
+
+	//targets block, the labels are recomputed
+	outfile.write(padding.data(), h.targets_offset - h.features_offset - rows * features * sizeof(double));
+	for (size_t i = 0; i < rows; i++)
+	{
+		buffer.push_back(rowLabel(seed, i));
+		if (i % block == block - 1 || i == rows - 1)
+		{
+			checksum = datasetChecksum(buffer.data(), buffer.size() * sizeof(double), checksum);
+			outfile.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(double));
+			buffer.clear();
+		}
+	}
+
+	h.checksum = checksum;
+	outfile.seekp(0);
+	outfile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	return bool(outfile);
+}
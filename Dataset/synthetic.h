@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+//Deterministic two-class generator for scaling tests, written straight to a text or binary dataset file
+//without holding the data in memory. Parameters (all optional):
+//  rows (1000), features (2), informative (2), separation (2), seed (0)
+//Features 0 and 1 follow the two Gaussian blobs of data1000.txt, the next informative ones are shifted by
+//+-separation/2 depending on the class, the others are pure N(0,1) noise. The label is the last column.
+bool generateDataset(const string& filename, unordered_map<string, double> parameters, bool binary);
@@ -7,21 +7,58 @@
 #include <utility>
 #include <limits>
 #include <string>
+#include "../dataset/row.h"
 
 using namespace std;
 
+//Precision of the sigmoid, see the error bounds below
+enum ActivationMode
+{
+	EXACT_ACTIVATION = 0,
+	POLYNOMIAL_ACTIVATION,
+	TABLE_ACTIVATION
+};
+
+#define SIGMOID_POLYNOMIAL_MAX_ERROR 1e-7
+#define SIGMOID_TABLE_MAX_ERROR 1e-6
+#define SIGMOID_TABLE_RANGE 16.0 //table over [-16, 16], saturated beyond
+#define SIGMOID_TABLE_SIZE 4096
+
 //Sigmoid Function
 double sigmoid(double x);
 double sigmoid_derivative(double x);
 
+//exp(-x) range reduced to 2^n e^r with |r| <= ln(2)/2, e^r by a degree 6 polynomial:
+//|error| < SIGMOID_POLYNOMIAL_MAX_ERROR
+double sigmoid_polynomial(double x);
+
+//linear interpolation in a SIGMOID_TABLE_SIZE table: |error| < SIGMOID_TABLE_MAX_ERROR
+double sigmoid_table(double x);
+
+double sigmoid(double x, ActivationMode mode);
+
+//n values in place
+void sigmoid(double* x, size_t n, ActivationMode mode);
+
+//largest error of a mode against sigmoid over a fine sweep of [-40, 40], to check the bounds above
+double sigmoid_max_error(ActivationMode mode);
+
 //Relu Function
 double relu(double x);
 double relu_derivative(double x);
 
+//Softmax Function: p = softmax(z) over n values read every 'stride' doubles (in place allowed). The maximum is
+//subtracted first, so large logits cannot overflow
+void softmax(const double* z, double* p, size_t n, size_t stride = 1);
+
+//Softmax and cross entropy fused, for rows x n logits: returns the summed loss -sum(y log p) and, if delta is not
+//null, writes the gradient of the loss with respect to the logits, p - y (targets are distributions)
+double softmax_cross_entropy(const double* z, const double* y, double* delta, size_t rows, size_t n);
+
 //Random float getter function
 double random(double low,double high);
 
-double distanceVector(const vector<double>& v1, const vector<double>& v2);
+double distanceVector(const Row& v1, const Row& v2);
 
 
 #endif // FUNCTIONS_H
\ No newline at end of file
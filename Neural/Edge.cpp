@@ -49,20 +49,45 @@ void Edge::propagate(double neuron_output)
 
 void Edge::alterWeight(double w)
 {
-    _w = w;
+    _w = _pruned ? 0 : w;
+    if (_dirty)
+        *_dirty = 1;
 
 }
 
 void Edge::shiftWeight(double dw)
 {
+	if (_pruned)
+	{
+		_last_shift = 0;
+		return;
+	}
 	dw *= LEARNING_RATE;
 	_w += dw;
 	_last_shift = dw;
+	if (_dirty)
+		*_dirty = 1;
 }
 
 void Edge::resetLastShift()
 {
 	_w -= _last_shift;
+	if (_dirty)
+		*_dirty = 1;
+}
+
+void Edge::prune()
+{
+	_pruned = true;
+	_w = 0;
+	_last_shift = 0;
+	if (_dirty)
+		*_dirty = 1;
+}
+
+bool Edge::isPruned() const
+{
+	return _pruned;
 }
 
 double Edge::getLastShift() const
@@ -79,4 +104,21 @@ double Edge::backpropagationMemory() const
 void Edge::setBackpropagationMemory(double v)
 {
 	_backpropagation_memory = v;
-}
\ No newline at end of file
+}
+
+double Edge::tangent() const
+{
+	return _tangent;
+}
+
+void Edge::setTangent(double t)
+{
+	_tangent = t;
+}
+
+void Edge::propagateTangent(double neuron_output, double neuron_tangent)
+{
+	// d(o*w) = do*w + o*dw
+	neuron()->addAccumulated(neuron_output * weight());
+	neuron()->addAccumulatedTangent(neuron_tangent * weight() + neuron_output * _tangent);
+}
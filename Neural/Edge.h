@@ -130,6 +130,28 @@ class Edge{
                 Sets the backpropagation memory value to the specified value (v)
             */
 
+            double tangent() const;
+            /*
+                Returns the component of the forward-mode direction attached to this edge
+            */
+
+            void setTangent(double t);
+            /*
+                Sets the component of the forward-mode direction attached to this edge (see NeuralNetwork::setDirection)
+            */
+
+            void propagateTangent(double neuron_output, double neuron_tangent);
+            /*
+                Forward-mode propagation: pushes both the value and its directional derivative to the next neuron
+            */
+
+            void prune();
+            /*
+                Masks this edge for good: its weight becomes 0 and alterWeight / shiftWeight leave it there (see NeuralNetwork::prune)
+            */
+
+            bool isPruned() const;
+
         
     public:
     // All the public variables
@@ -140,6 +162,12 @@ class Edge{
 
 	        double _backpropagation_memory; // Presumably, a variable for storing information related to backpropagation
 
+	        double _tangent = 0; // Direction component for forward-mode (directional derivative) passes
+
+	        char* _dirty = nullptr; // Dirty flag of the snapshot page holding this weight, set on every weight change (see SnapshotStore)
+
+	        bool _pruned = false; // Masked by pruning: the weight stays 0
+
 };
 
 
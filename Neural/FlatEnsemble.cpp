@@ -0,0 +1,194 @@
+#include "flatensemble.h"
+#include "../misc/functions.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define ENSEMBLE_TILE 8 //samples per tile in forwardBatch
+
+//y[j][k] += x[k] * w[j][k], one input neuron of one sample. With K known at compile time the lane loop is unrolled.
+template <size_t K>
+static void stackedLanes(double* y, const double* x, const double* w, size_t out)
+{
+	double xk[K];
+	for (size_t k = 0; k < K; k++)
+		xk[k] = x[k];
+	for (size_t j = 0; j < out * K; j += K)
+		for (size_t k = 0; k < K; k++)
+			y[j + k] += xk[k] * w[j + k];
+}
+
+static void stackedLanes(double* y, const double* x, const double* w, size_t out, size_t K)
+{
+	switch (K)
+	{
+	case 2: return stackedLanes<2>(y, x, w, out);
+	case 4: return stackedLanes<4>(y, x, w, out);
+	case 8: return stackedLanes<8>(y, x, w, out);
+	case 16: return stackedLanes<16>(y, x, w, out);
+	}
+	for (size_t j = 0; j < out * K; j += K)
+		for (size_t k = 0; k < K; k++)
+			y[j + k] += x[k] * w[j + k];
+}
+
+
+FlatEnsemble::FlatEnsemble(const vector<const FlatNetwork*>& models, EnsembleCombine combine) :
+	_k(models.size()), _combine(combine)
+{
+	if (models.empty() || !models[0]->isOpen())
+		return;
+	const auto& shape = models[0]->layers();
+	_activation_mode = models[0]->activationMode();
+	for (const FlatNetwork* m : models)
+	{
+		if (!m->isOpen() || m->layers().size() != shape.size())
+			return;
+		for (size_t l = 0; l < shape.size(); l++)
+			if (m->layers()[l].size != shape[l].size || m->layers()[l].activation != shape[l].activation
+				|| m->layers()[l].type != shape[l].type)
+				return;
+	}
+
+	vector<StackedLayer> layers(shape.size());
+	for (size_t l = 0; l < shape.size(); l++)
+	{
+		layers[l].size = shape[l].size;
+		layers[l].type = shape[l].type;
+		layers[l].activation = shape[l].activation;
+		_max_width = max(_max_width, shape[l].size);
+		if (l + 1 == shape.size())
+			break;
+		size_t next = shape[l + 1].size;
+		layers[l].w.resize(shape[l].size * next * _k);
+		layers[l].b.resize(next * _k);
+		for (size_t k = 0; k < _k; k++)
+		{
+			const FlatNetwork::FlatLayer& fl = models[k]->layers()[l];
+			for (size_t i = 0; i < shape[l].size; i++)
+				for (size_t j = 0; j < next; j++)
+					layers[l].w[(i * next + j) * _k + k] = fl.row_ptr ? models[k]->weight(l, i, j) : fl.w[i * next + j];
+			for (size_t j = 0; j < next; j++)
+				layers[l].b[j * _k + k] = fl.b[j];
+		}
+	}
+	_layers = move(layers);
+}
+
+bool FlatEnsemble::isOpen() const
+{
+	return _layers.size() >= 2;
+}
+
+size_t FlatEnsemble::modelCount() const
+{
+	return _k;
+}
+
+size_t FlatEnsemble::inputSize() const
+{
+	return _layers.front().size;
+}
+
+size_t FlatEnsemble::outputSize() const
+{
+	return _layers.back().size;
+}
+
+//lanes: [outputs][K]
+void FlatEnsemble::combine(const double* lanes, double* out) const
+{
+	size_t n_out = outputSize();
+	fill(out, out + n_out, 0.0);
+	if (_combine == ENSEMBLE_AVERAGE)
+	{
+		for (size_t j = 0; j < n_out; j++)
+		{
+			for (size_t k = 0; k < _k; k++)
+				out[j] += lanes[j * _k + k];
+			out[j] /= _k;
+		}
+		return;
+	}
+
+	for (size_t k = 0; k < _k; k++)
+	{
+		size_t vote = 0;
+		if (n_out == 1)
+			vote = lanes[k] > 0.5 ? 0 : n_out;
+		else
+			for (size_t j = 1; j < n_out; j++)
+				if (lanes[j * _k + k] > lanes[vote * _k + k])
+					vote = j;
+		if (vote < n_out)
+			out[vote] += 1.0 / _k;
+	}
+}
+
+void FlatEnsemble::forward(const double* in, double* out, vector<double>& workspace) const
+{
+	forwardBatch(in, 1, out, workspace);
+}
+
+//Same tiling as FlatNetwork::forwardBatch. The first layer broadcasts each input value over the K lanes of a weight
+//row; the next ones multiply lane by lane.
+void FlatEnsemble::forwardBatch(const double* in, size_t n, double* out, vector<double>& workspace) const
+{
+	const size_t K = _k;
+	const size_t tile_width = _max_width * K;
+	workspace.resize(2 * ENSEMBLE_TILE * tile_width);
+	for (size_t first = 0; first < n; first += ENSEMBLE_TILE)
+	{
+		size_t rows = min<size_t>(ENSEMBLE_TILE, n - first);
+		double* cur = workspace.data();
+		double* next = workspace.data() + ENSEMBLE_TILE * tile_width;
+
+		for (size_t l = 0; l + 1 < _layers.size(); l++)
+		{
+			const StackedLayer& sl = _layers[l];
+			size_t width = _layers[l + 1].size * K;
+			for (size_t r = 0; r < rows; r++)
+				memcpy(next + r * width, sl.b.data(), width * sizeof(double));
+			for (size_t i = 0; i < sl.size; i++)
+			{
+				const double* w = &sl.w[i * width];
+				for (size_t r = 0; r < rows; r++)
+				{
+					double* y = next + r * width;
+					if (l > 0)
+					{
+						stackedLanes(y, cur + (r * sl.size + i) * K, w, _layers[l + 1].size, K);
+						continue;
+					}
+					double xi = in[(first + r) * sl.size + i];
+					if (xi == 0)
+						continue;
+					for (size_t m = 0; m < width; m++)
+						y[m] += xi * w[m];
+				}
+			}
+
+			double* a = next;
+			if (_layers[l + 1].type == LayerType::SOFTMAX) //one softmax per row and lane
+				for (size_t r = 0; r < rows; r++)
+					for (size_t k = 0; k < K; k++)
+						softmax(a + r * width + k, a + r * width + k, _layers[l + 1].size, K);
+			else if (_layers[l + 1].activation == ActivationFunction::SIGMOID)
+				sigmoid(a, rows * width, _activation_mode);
+			else if (_layers[l + 1].activation == ActivationFunction::RELU)
+				for (size_t m = 0; m < rows * width; m++)
+					a[m] = relu(a[m]);
+			swap(cur, next);
+		}
+
+		for (size_t r = 0; r < rows; r++)
+			combine(cur + r * outputSize() * K, out + (first + r) * outputSize());
+	}
+}
+
+vector<double> FlatEnsemble::predict(const Row& in)
+{
+	vector<double> out(outputSize());
+	forward(in.data(), out.data(), _workspace);
+	return out;
+}
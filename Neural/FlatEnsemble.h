@@ -0,0 +1,58 @@
+#ifndef FLATENSEMBLE_H
+#define FLATENSEMBLE_H
+
+#include "flatnetwork.h"
+#include <vector>
+
+using namespace std;
+
+enum EnsembleCombine
+{
+	ENSEMBLE_AVERAGE = 0, //mean of the outputs of the models
+	ENSEMBLE_VOTE //share of the models voting for each output (above 0.5 for one output, argmax otherwise)
+};
+
+//K networks of the same shape evaluated as one: the weights of the K models are interleaved, [in][out][K], so
+//each layer is a single kernel K lanes wide reading every input once, and the last layer combines the lanes.
+//Sparse (CSR) layers of the models are stacked dense. Sigmoids use the activation mode of the first model.
+class FlatEnsemble
+{
+public:
+	FlatEnsemble(const vector<const FlatNetwork*>& models, EnsembleCombine combine = ENSEMBLE_AVERAGE);
+
+	//false if the models do not all have the same layers
+	bool isOpen() const;
+
+	size_t modelCount() const;
+
+	size_t inputSize() const;
+
+	size_t outputSize() const;
+
+	void forward(const double* in, double* out, vector<double>& workspace) const;
+
+	void forwardBatch(const double* in, size_t n, double* out, vector<double>& workspace) const;
+
+	vector<double> predict(const Row& in);
+
+private:
+	struct StackedLayer
+	{
+		size_t size;
+		LayerType type;
+		ActivationFunction activation;
+		vector<double> w; //[size][next size][K]
+		vector<double> b; //[next size][K]
+	};
+
+	void combine(const double* lanes, double* out) const;
+
+	size_t _k = 0;
+	EnsembleCombine _combine;
+	vector<StackedLayer> _layers;
+	size_t _max_width = 0;
+	vector<double> _workspace;
+	ActivationMode _activation_mode = ActivationMode::EXACT_ACTIVATION;
+};
+
+#endif // FLATENSEMBLE_H
@@ -0,0 +1,518 @@
+#include "flatnetwork.h"
+#include "modelformat.h"
+#include "../dataset/mappedfile.h"
+#include "../dataset/datasetformat.h"
+#include "../misc/functions.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#define FLAT_TILE 32 //samples per tile in forwardBatch
+
+static uint64_t modelAlign(uint64_t offset)
+{
+	return (offset + MODEL_ALIGN - 1) / MODEL_ALIGN * MODEL_ALIGN;
+}
+
+//Edge from neuron i of layer l to neuron j of layer l+1 goes to w[i][j], or b[j] when i is the bias neuron.
+//Works from the neuron ids, so missing edges are zeros.
+FlatNetwork::FlatNetwork(NeuralNetwork& n) :
+	_activation_mode(n._activation_mode)
+{
+	const vector<Layer*>& layers = n._layers;
+	vector<size_t> sizes;
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		size_t size = 0;
+		for (Neuron* ne : layers[l]->neurons())
+			if (!ne->isBias())
+				size++;
+		sizes.push_back(size);
+		_max_width = max(_max_width, size);
+	}
+
+	for (size_t l = 0; l < layers.size(); l++)
+	{
+		FlatLayer fl = { layers[l]->getType(), layers[l]->getActivation(), sizes[l], nullptr, nullptr, nullptr, nullptr, 0 };
+		if (l + 1 < layers.size())
+		{
+			vector<double> w(sizes[l] * sizes[l + 1], 0), b(sizes[l + 1], 0);
+			for (Neuron* ne : layers[l]->neurons())
+				for (Edge* e : ne->_next)
+				{
+					size_t j = e->neuron()->getNeuronId();
+					if (ne->isBias())
+						b[j] = e->weight();
+					else
+						w[ne->getNeuronId() * sizes[l + 1] + j] = e->weight();
+				}
+			ownWeights(fl, sizes[l + 1], move(w), move(b));
+		}
+		_layers.push_back(fl);
+	}
+}
+
+void FlatNetwork::ownWeights(FlatLayer& fl, size_t next, vector<double>&& w, vector<double>&& b)
+{
+	size_t nnz = w.size() - count(w.begin(), w.end(), 0.0);
+	_values.push_back(move(b));
+	fl.b = _values.back().data();
+	if (w.empty() || nnz > (1 - FLAT_SPARSE_THRESHOLD) * w.size())
+	{
+		_values.push_back(move(w));
+		fl.w = _values.back().data();
+		return;
+	}
+
+	vector<uint64_t> row_ptr(1, 0);
+	vector<uint32_t> col;
+	vector<double> val;
+	for (size_t i = 0; i < fl.size; i++)
+	{
+		for (size_t j = 0; j < next; j++)
+			if (w[i * next + j] != 0)
+			{
+				col.push_back(uint32_t(j));
+				val.push_back(w[i * next + j]);
+			}
+		row_ptr.push_back(col.size());
+	}
+	fl.nnz = val.size();
+	_values.push_back(move(val));
+	_row_ptrs.push_back(move(row_ptr));
+	_cols.push_back(move(col));
+	fl.w = _values.back().data();
+	fl.row_ptr = _row_ptrs.back().data();
+	fl.col = _cols.back().data();
+}
+
+//count elements of elem_size bytes at offset: aligned, after the header and inside a file of size bytes, without overflow
+static bool modelBlockValid(uint64_t offset, uint64_t count, size_t elem_size, size_t size)
+{
+	return offset >= sizeof(ModelHeader) && offset % MODEL_ALIGN == 0 && offset <= size && count <= (size - offset) / elem_size;
+}
+
+//row_ptr starts at 0, never decreases and ends at nnz, the columns of a row are increasing and below next
+static bool csrValid(const FlatNetwork::FlatLayer& fl, size_t next)
+{
+	if (fl.row_ptr[0] != 0 || fl.row_ptr[fl.size] != fl.nnz)
+		return false;
+	for (size_t i = 0; i < fl.size; i++)
+	{
+		if (fl.row_ptr[i + 1] < fl.row_ptr[i] || fl.row_ptr[i + 1] > fl.nnz)
+			return false;
+		for (uint64_t k = fl.row_ptr[i]; k < fl.row_ptr[i + 1]; k++)
+			if (fl.col[k] >= next || (k > fl.row_ptr[i] && fl.col[k] <= fl.col[k - 1]))
+				return false;
+	}
+	return true;
+}
+
+//the header and the descriptors are untrusted: every block is checked before it is used in place
+FlatNetwork::FlatNetwork(const string& filename, bool verify_checksum) : _file(new MappedFile(filename))
+{
+	const char* data = _file->data();
+	size_t size = _file->size();
+	ModelHeader h;
+	if (!_file->isOpen() || size < sizeof(h))
+		return;
+	memcpy(&h, data, sizeof(h));
+	if (memcmp(h.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0 || h.version != MODEL_VERSION || h.size != size
+		|| h.n_layers < 2 || !modelBlockValid(h.layers_offset, h.n_layers, sizeof(ModelLayer), size))
+		return;
+	if (verify_checksum && datasetChecksum(data + sizeof(h), size - sizeof(h)) != h.checksum)
+		return;
+
+	vector<ModelLayer> ml(h.n_layers);
+	memcpy(ml.data(), data + h.layers_offset, h.n_layers * sizeof(ModelLayer));
+	for (const ModelLayer& m : ml)
+		if (m.type > SOFTMAX || m.activation > RELU || m.size > size / sizeof(double)) //bounds the workspace
+			return;
+	vector<FlatLayer> layers;
+	for (size_t l = 0; l < ml.size(); l++)
+	{
+		FlatLayer fl = { LayerType(ml[l].type), ActivationFunction(ml[l].activation), size_t(ml[l].size), nullptr, nullptr, nullptr, nullptr, 0 };
+		if (l + 1 < ml.size())
+		{
+			size_t next = ml[l + 1].size;
+			bool sparse = ml[l].index_offset != 0;
+			if (!sparse && next && fl.size > SIZE_MAX / sizeof(double) / next)
+				return;
+			size_t n_values = sparse ? ml[l].nnz : fl.size * next;
+			if (!modelBlockValid(ml[l].weights_offset, n_values, sizeof(double), size)
+				|| !modelBlockValid(ml[l].bias_offset, next, sizeof(double), size))
+				return;
+			fl.w = reinterpret_cast<const double*>(data + ml[l].weights_offset);
+			fl.b = reinterpret_cast<const double*>(data + ml[l].bias_offset);
+			if (sparse)
+			{
+				if (!modelBlockValid(ml[l].index_offset, fl.size + 1, sizeof(uint64_t), size))
+					return;
+				size_t col_offset = modelAlign(ml[l].index_offset + (fl.size + 1) * sizeof(uint64_t));
+				if (!modelBlockValid(col_offset, ml[l].nnz, sizeof(uint32_t), size))
+					return;
+				fl.nnz = ml[l].nnz;
+				fl.row_ptr = reinterpret_cast<const uint64_t*>(data + ml[l].index_offset);
+				fl.col = reinterpret_cast<const uint32_t*>(data + col_offset);
+				if (!csrValid(fl, next))
+					return;
+			}
+		}
+		layers.push_back(fl);
+		_max_width = max(_max_width, fl.size);
+	}
+	_layers = move(layers);
+}
+
+FlatNetwork::FlatNetwork()
+{
+}
+
+FlatNetwork::~FlatNetwork()
+{
+}
+
+bool FlatNetwork::isOpen() const
+{
+	return _layers.size() >= 2;
+}
+
+double FlatNetwork::weight(size_t l, size_t i, size_t j) const
+{
+	const FlatLayer& fl = _layers[l];
+	if (!fl.row_ptr)
+		return fl.w[i * _layers[l + 1].size + j];
+	const uint32_t* c = lower_bound(fl.col + fl.row_ptr[i], fl.col + fl.row_ptr[i + 1], uint32_t(j));
+	return c != fl.col + fl.row_ptr[i + 1] && *c == j ? fl.w[c - fl.col] : 0;
+}
+
+bool FlatNetwork::save(const string& filename) const
+{
+	if (!isOpen())
+		return false;
+
+	//layout first, then the blocks are written in order with their padding
+	ModelHeader h = {};
+	memcpy(h.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+	h.version = MODEL_VERSION;
+	h.n_layers = _layers.size();
+	h.layers_offset = sizeof(h);
+	vector<ModelLayer> ml(_layers.size());
+	uint64_t offset = modelAlign(h.layers_offset + ml.size() * sizeof(ModelLayer));
+	for (size_t l = 0; l < _layers.size(); l++)
+	{
+		const FlatLayer& fl = _layers[l];
+		ml[l] = { uint32_t(fl.type), uint32_t(fl.activation), fl.size, 0, 0, 0, 0 };
+		if (l + 1 < _layers.size())
+		{
+			size_t n_values = fl.row_ptr ? fl.nnz : fl.size * _layers[l + 1].size;
+			ml[l].weights_offset = offset;
+			ml[l].bias_offset = modelAlign(offset + n_values * sizeof(double));
+			offset = modelAlign(ml[l].bias_offset + _layers[l + 1].size * sizeof(double));
+			if (fl.row_ptr)
+			{
+				ml[l].nnz = fl.nnz;
+				ml[l].index_offset = offset;
+				offset = modelAlign(offset + (fl.size + 1) * sizeof(uint64_t));
+				offset = modelAlign(offset + fl.nnz * sizeof(uint32_t));
+			}
+		}
+	}
+	h.size = offset;
+
+	string body(h.size - sizeof(h), '\0');
+	auto put = [&](uint64_t at, const void* p, size_t bytes) { memcpy(&body[at - sizeof(h)], p, bytes); };
+	put(h.layers_offset, ml.data(), ml.size() * sizeof(ModelLayer));
+	for (size_t l = 0; l + 1 < _layers.size(); l++)
+	{
+		const FlatLayer& fl = _layers[l];
+		size_t n_values = fl.row_ptr ? fl.nnz : fl.size * _layers[l + 1].size;
+		put(ml[l].weights_offset, fl.w, n_values * sizeof(double));
+		put(ml[l].bias_offset, fl.b, _layers[l + 1].size * sizeof(double));
+		if (fl.row_ptr)
+		{
+			put(ml[l].index_offset, fl.row_ptr, (fl.size + 1) * sizeof(uint64_t));
+			put(modelAlign(ml[l].index_offset + (fl.size + 1) * sizeof(uint64_t)), fl.col, fl.nnz * sizeof(uint32_t));
+		}
+	}
+	h.checksum = datasetChecksum(body.data(), body.size());
+
+	ofstream file(filename, ios::binary);
+	file.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	file.write(body.data(), body.size());
+	return bool(file);
+}
+
+//complete connection, the edges missing from a CSR layer are pruned
+bool FlatNetwork::build(NeuralNetwork& n) const
+{
+	if (!isOpen() || !n._layers.empty())
+		return false;
+	for (const FlatLayer& fl : _layers)
+		n.addLayer({ { "type", fl.type }, { "size", double(fl.size) }, { "activation", fl.activation } });
+	for (size_t l = 0; l + 1 < _layers.size(); l++)
+	{
+		const FlatLayer& fl = _layers[l];
+		size_t next = _layers[l + 1].size;
+		Layer* in = n._layers[l];
+		Layer* out = n._layers[l + 1];
+		for (Neuron* ne : in->neurons())
+		{
+			size_t i = ne->getNeuronId();
+			if (ne->isBias())
+				for (size_t j = 0; j < next; j++)
+				{
+					ne->addNext(out->neurons()[j]);
+					ne->_next.back()->alterWeight(fl.b[j]);
+				}
+			else if (fl.row_ptr)
+			{
+				vector<char> stored(next, 0);
+				for (size_t j = 0; j < next; j++)
+					ne->addNext(out->neurons()[j]);
+				for (uint64_t k = fl.row_ptr[i]; k < fl.row_ptr[i + 1]; k++)
+				{
+					ne->_next[fl.col[k]]->alterWeight(fl.w[k]);
+					stored[fl.col[k]] = 1;
+				}
+				for (size_t j = 0; j < next; j++)
+					if (!stored[j])
+						ne->_next[j]->prune();
+			}
+			else
+				for (size_t j = 0; j < next; j++)
+				{
+					ne->addNext(out->neurons()[j]);
+					ne->_next.back()->alterWeight(fl.w[i * next + j]);
+				}
+		}
+	}
+	n.updateSparse();
+	return true;
+}
+
+//Each pass works on dense copies of the matrices and runs until nothing changes
+FlatNetwork* FlatNetwork::optimized() const
+{
+	struct DenseLayer
+	{
+		LayerType type;
+		ActivationFunction activation;
+		size_t size;
+		vector<double> w; //[size][next size]
+		vector<double> b;
+	};
+	vector<DenseLayer> d(_layers.size());
+	for (size_t l = 0; l < _layers.size(); l++)
+	{
+		d[l] = { _layers[l].type, _layers[l].activation, _layers[l].size, {}, {} };
+		if (l + 1 == _layers.size())
+			break;
+		size_t next = _layers[l + 1].size;
+		d[l].w.resize(d[l].size * next);
+		for (size_t i = 0; i < d[l].size; i++)
+			for (size_t j = 0; j < next; j++)
+				d[l].w[i * next + j] = weight(l, i, j);
+		d[l].b.assign(_layers[l].b, _layers[l].b + next);
+	}
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+
+		//x W1 + b1 through a linear layer then W2, b2: x (W1 W2) + (b1 W2 + b2)
+		for (size_t l = 1; l + 1 < d.size(); l++)
+		{
+			size_t a = d[l - 1].size, m = d[l].size, c = d[l + 1].size;
+			if (d[l].type == LayerType::SOFTMAX || d[l].activation != ActivationFunction::LINEAR || a * c > a * m + m * c)
+				continue;
+			vector<double> w(a * c, 0), b(d[l].b);
+			for (size_t i = 0; i < a; i++)
+				for (size_t k = 0; k < m; k++)
+				{
+					double x = d[l - 1].w[i * m + k];
+					if (x != 0)
+						for (size_t j = 0; j < c; j++)
+							w[i * c + j] += x * d[l].w[k * c + j];
+				}
+			for (size_t k = 0; k < m; k++)
+				for (size_t j = 0; j < c; j++)
+					b[j] += d[l - 1].b[k] * d[l].w[k * c + j];
+			d[l - 1].w = move(w);
+			d[l - 1].b = move(b);
+			d.erase(d.begin() + l);
+			changed = true;
+			break;
+		}
+
+		//dead and constant hidden neurons
+		for (size_t l = 1; l + 1 < d.size() && !changed; l++)
+		{
+			if (d[l].type == LayerType::SOFTMAX) //its neurons depend on each other
+				continue;
+			size_t prev = d[l - 1].size, next = d[l + 1].size;
+			for (size_t j = 0; j < d[l].size; j++)
+			{
+				bool no_out = all_of(&d[l].w[j * next], &d[l].w[(j + 1) * next], [](double x) { return x == 0; });
+				bool no_in = true;
+				for (size_t i = 0; i < prev && no_in; i++)
+					no_in = d[l - 1].w[i * d[l].size + j] == 0;
+				if (!no_out && !no_in)
+					continue;
+
+				if (!no_out) //constant output, goes to the next bias
+				{
+					double c = d[l - 1].b[j];
+					activate(d[l].activation, &c, 1);
+					for (size_t k = 0; k < next; k++)
+						d[l].b[k] += c * d[l].w[j * next + k];
+				}
+				size_t size = d[l].size;
+				vector<double> w_in;
+				for (size_t i = 0; i < prev; i++)
+					for (size_t k = 0; k < size; k++)
+						if (k != j)
+							w_in.push_back(d[l - 1].w[i * size + k]);
+				d[l - 1].w = move(w_in);
+				d[l - 1].b.erase(d[l - 1].b.begin() + j);
+				d[l].w.erase(d[l].w.begin() + j * next, d[l].w.begin() + (j + 1) * next);
+				d[l].size--;
+				changed = true;
+				break;
+			}
+		}
+	}
+
+	FlatNetwork* n = new FlatNetwork();
+	n->_activation_mode = _activation_mode;
+	for (size_t l = 0; l < d.size(); l++)
+	{
+		FlatLayer fl = { d[l].type, d[l].activation, d[l].size, nullptr, nullptr, nullptr, nullptr, 0 };
+		if (l + 1 < d.size())
+			n->ownWeights(fl, d[l + 1].size, move(d[l].w), move(d[l].b));
+		n->_layers.push_back(fl);
+		n->_max_width = max(n->_max_width, fl.size);
+	}
+	return n;
+}
+
+size_t FlatNetwork::inputSize() const
+{
+	return _layers.front().size;
+}
+
+size_t FlatNetwork::outputSize() const
+{
+	return _layers.back().size;
+}
+
+const vector<FlatNetwork::FlatLayer>& FlatNetwork::layers() const
+{
+	return _layers;
+}
+
+void FlatNetwork::setActivationMode(ActivationMode mode)
+{
+	_activation_mode = mode;
+}
+
+ActivationMode FlatNetwork::activationMode() const
+{
+	return _activation_mode;
+}
+
+void FlatNetwork::activate(ActivationFunction f, double* x, size_t n) const
+{
+	if (f == ActivationFunction::SIGMOID)
+		sigmoid(x, n, _activation_mode);
+	else if (f == ActivationFunction::RELU)
+		for (size_t i = 0; i < n; i++)
+			x[i] = relu(x[i]);
+}
+
+void FlatNetwork::forward(const double* in, double* out, vector<double>& workspace) const
+{
+	forwardBatch(in, 1, out, workspace);
+}
+
+void FlatNetwork::forwardBatch(const double* in, size_t n, double* out, vector<double>& workspace) const
+{
+	forwardBatch(in, n, out, workspace, false);
+}
+
+//Tiles of FLAT_TILE samples go through every layer before the next tile, so that a tile stays in cache.
+//Each row of a weight matrix is read once per tile and applied to every sample of the tile.
+void FlatNetwork::forwardBatch(const double* in, size_t n, double* out, vector<double>& workspace, bool logits) const
+{
+	workspace.resize(2 * FLAT_TILE * _max_width);
+	for (size_t first = 0; first < n; first += FLAT_TILE)
+	{
+		size_t rows = min<size_t>(FLAT_TILE, n - first);
+		const double* cur = in + first * _layers[0].size;
+		double* next = workspace.data();
+		double* spare = workspace.data() + FLAT_TILE * _max_width;
+
+		for (size_t l = 0; l + 1 < _layers.size(); l++)
+		{
+			const FlatLayer& fl = _layers[l];
+			size_t width = _layers[l + 1].size;
+			for (size_t r = 0; r < rows; r++)
+				memcpy(next + r * width, fl.b, width * sizeof(double));
+			for (size_t i = 0; i < fl.size; i++)
+			{
+				if (fl.row_ptr) //CSR row: scattered into the outputs
+				{
+					const uint32_t* col = fl.col + fl.row_ptr[i];
+					const double* val = fl.w + fl.row_ptr[i];
+					size_t nnz = fl.row_ptr[i + 1] - fl.row_ptr[i];
+					for (size_t r = 0; r < rows; r++)
+					{
+						double xi = cur[r * fl.size + i];
+						if (xi == 0)
+							continue;
+						double* y = next + r * width;
+						for (size_t k = 0; k < nnz; k++)
+							y[col[k]] += xi * val[k];
+					}
+					continue;
+				}
+				const double* w = fl.w + i * width;
+				for (size_t r = 0; r < rows; r++)
+				{
+					double xi = cur[r * fl.size + i];
+					if (xi == 0)
+						continue;
+					double* y = next + r * width;
+					for (size_t j = 0; j < width; j++)
+						y[j] += xi * w[j];
+				}
+			}
+			bool to_loss = logits && l + 2 == _layers.size(); //the loss applies the output activation itself
+			if (_layers[l + 1].type == LayerType::SOFTMAX && !to_loss)
+				for (size_t r = 0; r < rows; r++)
+					softmax(next + r * width, next + r * width, width);
+			else if (!to_loss)
+				activate(_layers[l + 1].activation, next, rows * width);
+			cur = next;
+			swap(next, spare);
+		}
+		memcpy(out + first * outputSize(), cur, rows * outputSize() * sizeof(double));
+	}
+}
+
+vector<double> FlatNetwork::predict(const Row& in)
+{
+	vector<double> out(outputSize());
+	forward(in.data(), out.data(), _workspace);
+	return out;
+}
+
+double FlatNetwork::lossBatch(const double* in, const double* target, size_t n, const Loss& loss, vector<double>& workspace) const
+{
+	vector<double> z(n * outputSize());
+	forwardBatch(in, n, z.data(), workspace, true);
+	return loss.evaluate(z.data(), target, nullptr, n, outputSize(), workspace);
+}
@@ -0,0 +1,98 @@
+#ifndef FLATNETWORK_H
+#define FLATNETWORK_H
+
+#include "neuralnetwork.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FLAT_SPARSE_THRESHOLD 0.7
+
+class MappedFile;
+using namespace std;
+
+//Inference only copy of a NeuralNetwork: for each layer, an [in][out] weight matrix and a bias vector (the weights
+//of the bias neuron). A matrix with more than FLAT_SPARSE_THRESHOLD zeros (pruned networks) is kept in CSR form, one
+//row per input neuron. The matrices are either owned, or used in place from a memory mapped model file
+//(see modelformat.h), so loading a model costs no parsing and no copy.
+class FlatNetwork
+{
+public:
+	struct FlatLayer
+	{
+		LayerType type;
+		ActivationFunction activation;
+		size_t size; //without the bias neuron
+		const double* w; //[size][next size], or the nnz values of a CSR matrix. Null for the last layer
+		const double* b; //[next size]
+		const uint64_t* row_ptr; //CSR only: [size + 1]
+		const uint32_t* col; //CSR only: [nnz]
+		size_t nnz;
+	};
+
+	FlatNetwork(NeuralNetwork& n);
+
+	FlatNetwork(const string& filename, bool verify_checksum = true);
+
+	~FlatNetwork();
+
+	bool isOpen() const;
+
+	//weight from neuron i of layer l to neuron j of layer l + 1, dense or not
+	double weight(size_t l, size_t i, size_t j) const;
+
+	bool save(const string& filename) const;
+
+	//Rebuilds the object network (e.g. to train again) into an empty NeuralNetwork
+	bool build(NeuralNetwork& n) const;
+
+	//Smaller equivalent network for deployment (caller owns it). Hidden LINEAR layers are folded into the next
+	//matrix when that does not cost more multiplications, hidden neurons without outgoing weights are dropped,
+	//and hidden neurons without incoming weights (constant outputs) are folded into the next bias vector.
+	FlatNetwork* optimized() const;
+
+	size_t inputSize() const;
+
+	size_t outputSize() const;
+
+	const vector<FlatLayer>& layers() const;
+
+	//Precision of the sigmoid layers, taken from the NeuralNetwork it was built from (exact for model files)
+	void setActivationMode(ActivationMode mode);
+
+	ActivationMode activationMode() const;
+
+	//Thread safe, the workspace belongs to the caller
+	void forward(const double* in, double* out, vector<double>& workspace) const;
+
+	//n samples of inputSize() values in, n x outputSize() values out
+	void forwardBatch(const double* in, size_t n, double* out, vector<double>& workspace) const;
+
+	vector<double> predict(const Row& in);
+
+	//Summed loss of n samples against n x outputSize() targets. The last layer is left as accumulated values and
+	//the whole batch goes through the loss kernel, which applies the output activation
+	double lossBatch(const double* in, const double* target, size_t n, const Loss& loss, vector<double>& workspace) const;
+
+private:
+	FlatNetwork();
+
+	//logits: the output activation is not applied
+	void forwardBatch(const double* in, size_t n, double* out, vector<double>& workspace, bool logits) const;
+
+	//takes a dense matrix, kept as is or in CSR form
+	void ownWeights(FlatLayer& fl, size_t next, vector<double>&& w, vector<double>&& b);
+
+	void activate(ActivationFunction f, double* x, size_t n) const;
+
+	vector<FlatLayer> _layers;
+	vector<vector<double> > _values;
+	vector<vector<uint64_t> > _row_ptrs;
+	vector<vector<uint32_t> > _cols;
+	unique_ptr<MappedFile> _file;
+	size_t _max_width = 0;
+	vector<double> _workspace;
+	ActivationMode _activation_mode = ActivationMode::EXACT_ACTIVATION;
+};
+
+#endif // FLATNETWORK_H
@@ -1,4 +1,5 @@
 #include "layer.h"
+#include "neuralnetwork.h"
 
 Layer::Layer(int id_layer, NeuralNetwork* net, unordered_map<string, double> parameters){
     _id_layer = id_layer;
@@ -38,7 +39,7 @@ void Layer::initLayer(){
          */
 			
 	}
-	else if (_type == LayerType::OUTPUT)
+	else if (_type == LayerType::OUTPUT || _type == LayerType::SOFTMAX)
 	{
 		_neurons.reserve(static_cast<int>(_parameters["size"]));
 		for (int i_neuron = 0; i_neuron < _parameters["size"]; ++i_neuron)
@@ -52,10 +53,51 @@ void Layer::clean(){
 }
 
 void Layer::trigger(){
+	if (_type == LayerType::SOFTMAX)
+		normalize();
     for(Neuron* n : _neurons)
         n->trigger();
 } // Trigger the neurons, see Neuron.cpp
 
+void Layer::triggerSparse(const vector<uint>& active){
+    for(uint i : active)
+        _neurons[i]->trigger();
+    if(!_neurons.empty() && _neurons.back()->isBias())
+        _neurons.back()->trigger();
+} // Only the listed neurons (and the bias) propagate, the others are known to output 0
+
+void Layer::triggerTangent(){
+	if (_type == LayerType::SOFTMAX)
+		normalizeTangent();
+    for(Neuron* n : _neurons)
+        n->triggerTangent();
+} // Forward-mode trigger, see Neuron::triggerTangent
+
+void Layer::triggerTangentSparse(const vector<uint>& active){
+    for(uint i : active)
+        _neurons[i]->triggerTangent();
+    if(!_neurons.empty() && _neurons.back()->isBias())
+        _neurons.back()->triggerTangent();
+} // Forward-mode triggerSparse
+
+void Layer::normalize(){
+	_softmax.resize(_neurons.size());
+	for (size_t i = 0; i < _neurons.size(); i++)
+		_softmax[i] = _neurons[i]->in();
+	softmax(_softmax.data(), _softmax.data(), _softmax.size());
+}
+
+// dp_i = p_i * (dz_i - sum_j p_j dz_j)
+void Layer::normalizeTangent(){
+	normalize();
+	double mean = 0;
+	for (size_t i = 0; i < _neurons.size(); i++)
+		mean += _softmax[i] * _neurons[i]->_accumulated_tangent;
+	_softmax_tangent.resize(_neurons.size());
+	for (size_t i = 0; i < _neurons.size(); i++)
+		_softmax_tangent[i] = _softmax[i] * (_neurons[i]->_accumulated_tangent - mean);
+}
+
 void Layer::connectComplete(Layer *next){
     for(Neuron* n1 : _neurons)
         for(Neuron* n2 : next->_neurons)
@@ -172,19 +214,51 @@ const unordered_map<string, double>& Layer::getParameters() const{
 	return _parameters;
 }
 
-vector<vector<double>> Layer::getBackpropagationShifts(const vector<double>& target){
+EdgeRange Layer::nextEdges(size_t i) const{
+	if (_sparse_next)
+		return { _next_edges.data() + _next_ptr[i], _next_edges.data() + _next_ptr[i + 1] };
+	const vector<Edge*>& e = _neurons[i]->_next;
+	return { e.data(), e.data() + e.size() };
+}
+
+void Layer::addBackpropagationShifts(const Row& target, vector<vector<double> >& dw, double* loss){
+	if (_type == LayerType::OUTPUT || _type == LayerType::SOFTMAX)
+	{
+		double l = outputDelta(target);
+		if (loss)
+			*loss = l;
+	}
+	for (size_t i = 0; i < _neurons.size(); i++)
+		_neurons[i]->addBackpropagationShifts(dw[i]);
+}
+
+vector<vector<double>> Layer::getBackpropagationShifts(const Row& target, double* loss){
 	vector<vector<double>> dw(_neurons.size());
+	if (_type == LayerType::OUTPUT || _type == LayerType::SOFTMAX)
+	{
+		double l = outputDelta(target);
+		if (loss)
+			*loss = l;
+	}
     /*
         This line declares a local vector of vectors called dw where the backpropagation weight adjustment shifts will be stored. 
         It is initialized with a size equal to the number of neurons in the layer (_neurons.size()).
     */
 	for (size_t i = 0; i < _neurons.size(); i++){
 		Neuron* n = _neurons[i];
-		dw[i] = n->getBackpropagationShifts(target);
+		dw[i] = n->getBackpropagationShifts();
 	}
 	return dw;
 }
 
+double Layer::outputDelta(const Row& target){
+	_z.resize(_neurons.size());
+	for (size_t i = 0; i < _neurons.size(); i++)
+		_z[i] = _neurons[i]->in();
+	_delta.resize(_neurons.size());
+	return _net->getLoss().evaluate(_z.data(), target.data(), _delta.data(), 1, _z.size(), _loss_workspace);
+}
+
 LayerType Layer::getType() const{
 	return _type;
 }
@@ -21,12 +21,21 @@ enum LayerType
 	STANDARD = 0, //Standard layer : fully connected perceptrons
 	OUTPUT, // Output : No bias neuron
 	INPUT, // Input: Standard input (output of neurons is outputRaw() )
-	SOFTMAX //K-Class Classification Layer 
+	SOFTMAX //K-Class Classification Layer : no bias neuron, outputs the softmax of the accumulated values
 
 };
 
 enum ActivationFunction;
 
+//[begin, end) of an array of edges, for range-based loops
+struct EdgeRange
+{
+	Edge* const* first;
+	Edge* const* last;
+	Edge* const* begin() const { return first; }
+	Edge* const* end() const { return last; }
+};
+
 //Layer of the network
 class Layer
 {
@@ -43,6 +52,12 @@ public:
 
     void trigger();
 
+	void triggerTangent();
+
+	void triggerSparse(const vector<uint>& active);
+
+	void triggerTangentSparse(const vector<uint>& active);
+
     void connectComplete(Layer* next);
 
     vector<double> output();
@@ -65,7 +80,12 @@ public:
 
 	const unordered_map<string, double>& getParameters() const;
 
-	vector<vector<double> > getBackpropagationShifts(const vector<double>& target);
+	//loss receives the loss of the sample when this is the output layer
+	vector<vector<double> > getBackpropagationShifts(const Row& target, double* loss = nullptr);
+
+	//Output layer: error terms of its neurons for the target, in _delta, from the loss of the network.
+	//Returns the loss
+	double outputDelta(const Row& target);
 
 	LayerType getType() const;
 
@@ -73,6 +93,19 @@ public:
 
 	NeuralNetwork* getNet() const { return _net; }
 
+	//edges leaving neuron i that the forward and backward passes go through: all its edges, or only the unpruned
+	//ones once the layer is sparse
+	EdgeRange nextEdges(size_t i) const;
+
+	//Same update as getBackpropagationShifts, added to dw (same layout) instead of allocating it: once the layer is
+	//sparse, only the entries of the unpruned incoming edges are computed
+	void addBackpropagationShifts(const Row& target, vector<vector<double> >& dw, double* loss = nullptr);
+
+	//SOFTMAX layers: softmax of the accumulated values (and of their tangents), read back by the neurons
+	void normalize();
+
+	void normalizeTangent();
+
 public:
 	NeuralNetwork* _net;
     int _id_layer;
@@ -80,6 +113,22 @@ public:
 	LayerType _type;
 	ActivationFunction _activation;
 	unordered_map<string, double> _parameters;
+	vector<double> _softmax;
+	vector<double> _softmax_tangent;
+	vector<double> _delta;
+	vector<double> _z; //accumulated values handed to the loss by outputDelta
+	vector<double> _loss_workspace;
+
+	//Sparse path of pruned networks, see NeuralNetwork::updateSparse. Once more than FLAT_SPARSE_THRESHOLD of the
+	//edges to the next layer are pruned, only the others are visited. _next_edges holds them by neuron of this
+	//layer (CSR, [_next_ptr[i], _next_ptr[i + 1]) for neuron i); the next layer gets the same edges by its own
+	//neurons, as indices in their _previous
+	bool _sparse_next = false;
+	vector<size_t> _next_ptr;
+	vector<Edge*> _next_edges;
+	bool _sparse_previous = false;
+	vector<size_t> _previous_ptr;
+	vector<uint> _previous_index;
 };
 
 #endif // LAYER_H
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "loss.h"
+#include "../misc/functions.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+Loss::Loss(LayerType type, ActivationFunction activation) :
+	_type(type), _activation(activation)
+{
+}
+
+Loss::~Loss()
+{
+}
+
+void Loss::activate(const double* z, double* o, size_t n) const
+{
+	if (_type == LayerType::SOFTMAX)
+		softmax(z, o, n);
+	else if (_activation == ActivationFunction::SIGMOID)
+		for (size_t i = 0; i < n; i++)
+			o[i] = sigmoid(z[i]);
+	else if (_activation == ActivationFunction::RELU)
+		for (size_t i = 0; i < n; i++)
+			o[i] = relu(z[i]);
+	else
+		copy(z, z + n, o);
+}
+
+//softmax: Jacobian times g, p_i * (g_i - sum_j p_j g_j)
+void Loss::chain(const double* o, const double* g, double* delta, size_t n) const
+{
+	if (_type == LayerType::SOFTMAX)
+	{
+		double mean = 0;
+		for (size_t i = 0; i < n; i++)
+			mean += o[i] * g[i];
+		for (size_t i = 0; i < n; i++)
+			delta[i] = o[i] * (g[i] - mean);
+	}
+	else if (_activation == ActivationFunction::SIGMOID)
+		for (size_t i = 0; i < n; i++)
+			delta[i] = g[i] * o[i] * (1 - o[i]);
+	else if (_activation == ActivationFunction::RELU)
+		for (size_t i = 0; i < n; i++)
+			delta[i] = o[i] > 0 ? g[i] : 0;
+	else
+		copy(g, g + n, delta);
+}
+
+
+class MseLoss : public Loss
+{
+public:
+	using Loss::Loss;
+
+	double evaluate(const double* z, const double* y, double* delta, size_t rows, size_t n, vector<double>& workspace) const
+	{
+		workspace.resize(2 * n);
+		double* o = workspace.data();
+		double* g = o + n;
+		double loss = 0;
+		for (size_t r = 0; r < rows; r++, z += n, y += n)
+		{
+			activate(z, o, n);
+			for (size_t i = 0; i < n; i++)
+			{
+				g[i] = o[i] - y[i];
+				loss += 0.5 * g[i] * g[i];
+			}
+			if (delta)
+				chain(o, g, delta + r * n, n);
+		}
+		return loss;
+	}
+};
+
+class BinaryCrossEntropyLoss : public Loss
+{
+public:
+	using Loss::Loss;
+
+	//sigmoid outputs: the loss is computed from z (max(z, 0) - z y + log(1 + exp(-|z|))), which cannot overflow
+	double evaluate(const double* z, const double* y, double* delta, size_t rows, size_t n, vector<double>& workspace) const
+	{
+		workspace.resize(2 * n);
+		double* o = workspace.data();
+		double* g = o + n;
+		bool fused = _type != LayerType::SOFTMAX && _activation == ActivationFunction::SIGMOID;
+		double loss = 0;
+		for (size_t r = 0; r < rows; r++, z += n, y += n)
+		{
+			if (fused)
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					loss += max(z[i], 0.0) - z[i] * y[i] + log1p(exp(-fabs(z[i])));
+					if (delta)
+						delta[r * n + i] = sigmoid(z[i]) - y[i];
+				}
+				continue;
+			}
+			activate(z, o, n);
+			for (size_t i = 0; i < n; i++)
+			{
+				double p = min(max(o[i], LOSS_EPSILON), 1 - LOSS_EPSILON);
+				loss -= y[i] * log(p) + (1 - y[i]) * log(1 - p);
+				g[i] = (p - y[i]) / (p * (1 - p));
+			}
+			if (delta)
+				chain(o, g, delta + r * n, n);
+		}
+		return loss;
+	}
+};
+
+class HuberLoss : public Loss
+{
+public:
+	using Loss::Loss;
+
+	double evaluate(const double* z, const double* y, double* delta, size_t rows, size_t n, vector<double>& workspace) const
+	{
+		workspace.resize(2 * n);
+		double* o = workspace.data();
+		double* g = o + n;
+		double loss = 0;
+		for (size_t r = 0; r < rows; r++, z += n, y += n)
+		{
+			activate(z, o, n);
+			for (size_t i = 0; i < n; i++)
+			{
+				double d = o[i] - y[i];
+				if (fabs(d) <= HUBER_DELTA)
+				{
+					loss += 0.5 * d * d;
+					g[i] = d;
+				}
+				else
+				{
+					loss += HUBER_DELTA * (fabs(d) - 0.5 * HUBER_DELTA);
+					g[i] = d > 0 ? HUBER_DELTA : -HUBER_DELTA;
+				}
+			}
+			if (delta)
+				chain(o, g, delta + r * n, n);
+		}
+		return loss;
+	}
+};
+
+class CrossEntropyLoss : public Loss
+{
+public:
+	using Loss::Loss;
+
+	//softmax outputs: the whole batch goes to softmax_cross_entropy
+	double evaluate(const double* z, const double* y, double* delta, size_t rows, size_t n, vector<double>& workspace) const
+	{
+		if (_type == LayerType::SOFTMAX)
+			return softmax_cross_entropy(z, y, delta, rows, n);
+
+		workspace.resize(2 * n);
+		double* o = workspace.data();
+		double* g = o + n;
+		double loss = 0;
+		for (size_t r = 0; r < rows; r++, z += n, y += n)
+		{
+			activate(z, o, n);
+			for (size_t i = 0; i < n; i++)
+			{
+				double p = max(o[i], LOSS_EPSILON);
+				loss -= y[i] * log(p);
+				g[i] = -y[i] / p;
+			}
+			if (delta)
+				chain(o, g, delta + r * n, n);
+		}
+		return loss;
+	}
+};
+
+
+Loss* Loss::create(LossFunction f, LayerType type, ActivationFunction activation)
+{
+	switch (f)
+	{
+	case LossFunction::BINARY_CROSS_ENTROPY:
+		return new BinaryCrossEntropyLoss(type, activation);
+	case LossFunction::HUBER:
+		return new HuberLoss(type, activation);
+	case LossFunction::CROSS_ENTROPY:
+		return new CrossEntropyLoss(type, activation);
+	default:
+		return new MseLoss(type, activation);
+	}
+}
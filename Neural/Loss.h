@@ -0,0 +1,49 @@
+#ifndef LOSS_H
+#define LOSS_H
+
+#include "layer.h"
+#include <vector>
+
+#define HUBER_DELTA 1.0
+#define LOSS_EPSILON 1e-12 //outputs are clamped away from 0 (and 1) before taking a log
+
+using namespace std;
+
+enum LossFunction
+{
+	MSE = 0, //0.5 * sum (o - y)^2
+	BINARY_CROSS_ENTROPY, //-sum y log(o) + (1 - y) log(1 - o), targets in [0, 1]
+	HUBER, //0.5 r^2 while |r| <= HUBER_DELTA, linear beyond
+	CROSS_ENTROPY //-sum y log(o), targets are distributions
+};
+
+//Loss of the output layer, fused with the activation of that layer: one call takes a batch of accumulated values
+//and targets, and gives the loss with the error terms the backpropagation starts from (derivatives of the loss
+//with respect to the accumulated values). Sigmoid with binary cross entropy and softmax with cross entropy
+//reduce to o - y.
+class Loss
+{
+public:
+	Loss(LayerType type, ActivationFunction activation);
+
+	virtual ~Loss();
+
+	//rows x n accumulated values z and targets y. Returns the summed loss of the rows, delta may be null.
+	//workspace is the caller's scratch (2n values), kept between calls so that the per-row kernels do not allocate
+	virtual double evaluate(const double* z, const double* y, double* delta, size_t rows, size_t n, vector<double>& workspace) const = 0;
+
+	//caller owns it
+	static Loss* create(LossFunction f, LayerType type, ActivationFunction activation);
+
+protected:
+	//outputs of one row of the layer
+	void activate(const double* z, double* o, size_t n) const;
+
+	//delta = dL/dz from g = dL/do, for one row
+	void chain(const double* o, const double* g, double* delta, size_t n) const;
+
+	LayerType _type;
+	ActivationFunction _activation;
+};
+
+#endif // LOSS_H
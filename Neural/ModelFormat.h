@@ -0,0 +1,44 @@
+#ifndef MODELFORMAT_H
+#define MODELFORMAT_H
+
+#include <cstdint>
+#include <cstddef>
+
+//Binary model file (little endian), made to be memory mapped and used in place:
+//  header (64 bytes)
+//  layer descriptors: n_layers x ModelLayer, at layers_offset
+//  per layer but the last: weights to the next layer, [size][next size] doubles row major, then the
+//  bias vector [next size], each block 64-byte aligned.
+//  Sparse (CSR) layers store the nnz values instead of the matrix, and an index block: row_ptr, (size + 1) uint64,
+//  then col, nnz uint32
+
+#define MODEL_MAGIC "NNMODL1"
+#define MODEL_VERSION 2
+#define MODEL_ALIGN 64
+
+struct ModelHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t n_layers;
+	uint64_t layers_offset;
+	uint64_t size; //whole file
+	uint64_t checksum; //datasetChecksum of everything after the header
+	uint64_t reserved[3];
+};
+
+struct ModelLayer
+{
+	uint32_t type; //LayerType
+	uint32_t activation; //ActivationFunction
+	uint64_t size; //neurons, without the bias neuron
+	uint64_t weights_offset; //0 for the last layer
+	uint64_t bias_offset;
+	uint64_t nnz;
+	uint64_t index_offset; //0 for dense layers
+};
+
+static_assert(sizeof(ModelHeader) == 64, "ModelHeader must stay 64 bytes");
+static_assert(sizeof(ModelLayer) == 48, "ModelLayer must stay 48 bytes");
+
+#endif // MODELFORMAT_H
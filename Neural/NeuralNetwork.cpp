@@ -1,6 +1,13 @@
 #include "neuralnetwork.h"
 #include "neuron.h"
 #include "../misc/functions.h"
+#include "flatnetwork.h"
+#include "modelformat.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 
 NeuralNetwork::NeuralNetwork(){
@@ -19,25 +26,129 @@ void NeuralNetwork::autogenerate(bool randomize){
 	
 }
 
+//edges are rebuilt one by one in the same order, then the pruned ones are masked again
+NeuralNetwork* NeuralNetwork::clone(){
+	NeuralNetwork* n = new NeuralNetwork();
+	for (auto& c : _configuration)
+		n->addLayer(c);
+	for (size_t i_layer = 0; i_layer + 1 < _layers.size(); ++i_layer)
+		for (Neuron* ne : _layers[i_layer]->neurons())
+			for (Edge* e : ne->_next)
+				n->_layers[i_layer]->neurons()[ne->getNeuronId()]->addNext(n->_layers[i_layer + 1]->neurons()[e->neuron()->getNeuronId()]);
+	n->setFlatWeights(getFlatWeights());
+	n->setPruneMask(getPruneMask());
+	n->_loss_function = _loss_function;
+	n->_default_loss = _default_loss;
+	n->_activation_mode = _activation_mode;
+	return n;
+}
+
 void NeuralNetwork::addLayer(unordered_map<string, double> parameters){
+	_configuration.push_back(parameters);
 	_layers.push_back(new Layer(_layers.size(), this, parameters));
+	_loss.reset();
 }
 
+bool NeuralNetwork::save(const string& filename){
+	ofstream file(filename);
+	if (!file)
+		return false;
+	vector<double> w = getFlatWeights();
+	file << "network " << _configuration.size() << " " << w.size() << "\n";
+	for (auto& c : _configuration)
+	{
+		file << "layer";
+		for (auto& p : c)
+			file << " " << p.first << " " << p.second;
+		file << "\n";
+	}
+	file.precision(17);
+	for (double x : w)
+		file << x << "\n";
+	return bool(file);
+}
+
+bool NeuralNetwork::load(const string& filename){
+	ifstream file(filename, ios::binary);
+	char magic[sizeof(MODEL_MAGIC)] = {};
+	file.read(magic, sizeof(magic));
+	if (memcmp(magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) == 0)
+		return FlatNetwork(filename).build(*this);
+	file.clear();
+	file.seekg(0);
+
+	string word;
+	size_t n_layers = 0, n_weights = 0;
+	if (!(file >> word >> n_layers >> n_weights) || word != "network" || !_layers.empty())
+		return false;
+	file.ignore(numeric_limits<streamsize>::max(), '\n');
+	for (size_t i = 0; i < n_layers; i++)
+	{
+		string line;
+		getline(file, line);
+		istringstream ss(line);
+		unordered_map<string, double> parameters;
+		string key;
+		double value;
+		ss >> word;
+		while (ss >> key >> value)
+			parameters[key] = value;
+		if (word != "layer")
+			return false;
+		addLayer(parameters);
+	}
+	autogenerate(false);
+
+	vector<double> w(n_weights);
+	for (double& x : w)
+		file >> x;
+	if (!file || w.size() != getFlatWeights().size())
+		return false;
+	setFlatWeights(w);
+	return true;
+}
 
 void NeuralNetwork::clean(){
     for(Layer* l : _layers)
         l->clean();
 }
 
-void NeuralNetwork::setInput(vector<double> in){
+void NeuralNetwork::setInput(const Row& in){
 	clean();
+	_sparse_input = false;
+	_active_inputs.clear();
     for(size_t i=0; i<in.size(); ++i)
         _layers[0]->neurons()[i]->setAccumulated(in[i]);
 }
 
+void NeuralNetwork::setInput(const SparseRow& in){
+	for (size_t i = 1; i < _layers.size(); ++i)
+		_layers[i]->clean();
+	for (uint i : _active_inputs)
+		_layers[0]->neurons()[i]->setAccumulated(0);
+	_active_inputs.clear();
+	const vector<Neuron*>& inputs = _layers[0]->neurons();
+	size_t width = inputs.size() - (!inputs.empty() && inputs.back()->isBias() ? 1 : 0);
+	for (size_t k = 0; k < in.nnz(); ++k)
+	{
+		uint i = in.indices()[k];
+		if (i >= width)
+		{
+			cerr << "sparse input index " << i << " out of range, the network has " << width << " inputs" << endl;
+			continue;
+		}
+		_active_inputs.push_back(i);
+		inputs[i]->setAccumulated(in.values()[k]);
+	}
+	_sparse_input = true;
+}
+
 void NeuralNetwork::trigger(){
-	for (Layer* l : _layers)
-		l->trigger();
+	for (size_t i = 0; i < _layers.size(); ++i)
+		if (i == 0 && _sparse_input)
+			_layers[0]->triggerSparse(_active_inputs);
+		else
+			_layers[i]->trigger();
 }
 
 vector<double> NeuralNetwork::output()
@@ -89,22 +200,168 @@ vector<vector<vector<Edge*>>> NeuralNetwork::getEdges(){
 	return std::move(w);
 }
 
+vector<double> NeuralNetwork::getFlatWeights(){
+	vector<double> w;
+	for (size_t i_layer = 0; i_layer < _layers.size() - 1; ++i_layer)
+		for (Neuron* n : _layers[i_layer]->neurons())
+			for (Edge* e : n->_next)
+				w.push_back(e->weight());
+	return w;
+}
+
+void NeuralNetwork::setFlatWeights(const vector<double>& weights){
+	setFlatWeights(weights.data());
+}
+
+void NeuralNetwork::setFlatWeights(const double* weights){
+	size_t k = 0;
+	for (size_t i_layer = 0; i_layer < _layers.size() - 1; ++i_layer)
+		for (Neuron* n : _layers[i_layer]->neurons())
+			for (Edge* e : n->_next)
+				e->alterWeight(weights[k++]);
+}
+
 void NeuralNetwork::randomizeAllWeights()
 {
 	for(size_t i_layer = 0; i_layer < _layers.size() - 1; ++i_layer)
 		_layers[i_layer]->randomizeAllWeights(RAND_MAX_WEIGHT); //random weights from -RAND_MAX_WEIGHT to RAND_MAX_WEIGHT
 }
 
-double NeuralNetwork::loss(const vector<double>& in, const vector<double>& out){
-	double sum = 0;
-	auto out_exp = predict(in);
-	if (_layers.back()->getParameters().at("activation") == ActivationFunction::SIGMOID)
-		for (size_t i = 0; i < out.size(); ++i)
-			sum += 0.5 * (out[i] - out_exp[i]) * (out[i] - out_exp[i]);
-	if (_layers.back()->getParameters().at("activation") == ActivationFunction::LINEAR)
-		for (size_t i = 0; i < out.size(); ++i)
-			sum += (out[i] - out_exp[i]) * (out[i] - out_exp[i]);
-	return sum;
+size_t NeuralNetwork::prune(double sparsity)
+{
+	size_t pruned = 0;
+	for (size_t i_layer = 0; i_layer + 1 < _layers.size(); ++i_layer)
+	{
+		vector<Edge*> edges;
+		for (Neuron* ne : _layers[i_layer]->neurons())
+			if (!ne->isBias())
+				edges.insert(edges.end(), ne->_next.begin(), ne->_next.end());
+
+		//the edges pruned before are zeros, so they are the first of the smallest ones
+		size_t n_pruned = min(edges.size(), size_t(sparsity * edges.size() + 0.5));
+		nth_element(edges.begin(), edges.begin() + n_pruned, edges.end(),
+			[](Edge* a, Edge* b) { return fabs(a->weight()) < fabs(b->weight()); });
+		for (size_t i = 0; i < n_pruned; i++)
+			if (!edges[i]->isPruned())
+			{
+				edges[i]->prune();
+				pruned++;
+			}
+	}
+	updateSparse();
+	return pruned;
+}
+
+double NeuralNetwork::sparsity()
+{
+	size_t edges = 0, pruned = 0;
+	for (size_t i_layer = 0; i_layer + 1 < _layers.size(); ++i_layer)
+		for (Neuron* ne : _layers[i_layer]->neurons())
+			if (!ne->isBias())
+				for (Edge* e : ne->_next)
+				{
+					edges++;
+					pruned += e->isPruned();
+				}
+	return edges ? double(pruned) / edges : 0;
+}
+
+vector<char> NeuralNetwork::getPruneMask()
+{
+	vector<char> mask;
+	for (size_t i_layer = 0; i_layer + 1 < _layers.size(); ++i_layer)
+		for (Neuron* n : _layers[i_layer]->neurons())
+			for (Edge* e : n->_next)
+				mask.push_back(e->isPruned());
+	return mask;
+}
+
+void NeuralNetwork::setPruneMask(const vector<char>& mask)
+{
+	size_t k = 0;
+	for (size_t i_layer = 0; i_layer + 1 < _layers.size(); ++i_layer)
+		for (Neuron* n : _layers[i_layer]->neurons())
+			for (Edge* e : n->_next)
+				if (mask[k++])
+					e->prune();
+	updateSparse();
+}
+
+//the edges stay where they are, the lists only point to them
+void NeuralNetwork::updateSparse()
+{
+	for (Layer* l : _layers)
+	{
+		l->_sparse_next = l->_sparse_previous = false;
+		l->_next_ptr.clear();
+		l->_next_edges.clear();
+		l->_previous_ptr.clear();
+		l->_previous_index.clear();
+	}
+	for (size_t i_layer = 0; i_layer + 1 < _layers.size(); ++i_layer)
+	{
+		Layer* l = _layers[i_layer];
+		Layer* next = _layers[i_layer + 1];
+		size_t edges = 0, pruned = 0;
+		for (Neuron* ne : l->neurons())
+			if (!ne->isBias())
+				for (Edge* e : ne->_next)
+				{
+					edges++;
+					pruned += e->isPruned();
+				}
+		if (edges == 0 || pruned <= FLAT_SPARSE_THRESHOLD * edges)
+			continue;
+
+		l->_next_ptr.push_back(0);
+		for (Neuron* ne : l->neurons())
+		{
+			for (Edge* e : ne->_next)
+				if (!e->isPruned())
+					l->_next_edges.push_back(e);
+			l->_next_ptr.push_back(l->_next_edges.size());
+		}
+		next->_previous_ptr.push_back(0);
+		for (Neuron* ne : next->neurons())
+		{
+			for (size_t i = 0; i < ne->_previous.size(); i++)
+				if (!ne->_previous[i]->isPruned())
+					next->_previous_index.push_back(uint(i));
+			next->_previous_ptr.push_back(next->_previous_index.size());
+		}
+		l->_sparse_next = next->_sparse_previous = true;
+	}
+}
+
+void NeuralNetwork::setLoss(LossFunction f){
+	_loss_function = f;
+	_default_loss = false;
+	_loss.reset();
+}
+
+const Loss& NeuralNetwork::getLoss(){
+	if (!_loss)
+	{
+		Layer* out = _layers.back();
+		LossFunction f = _loss_function;
+		if (_default_loss && out->getType() == LayerType::SOFTMAX)
+			f = LossFunction::CROSS_ENTROPY;
+		_loss.reset(Loss::create(f, out->getType(), out->getActivation()));
+	}
+	return *_loss;
+}
+
+void NeuralNetwork::setActivationMode(ActivationMode mode){
+	_activation_mode = mode;
+}
+
+double NeuralNetwork::outputLoss(const Row& target){
+	return _layers.back()->outputDelta(target);
+}
+
+double NeuralNetwork::loss(const Row& in, const Row& out){
+	predict(in);
+	return outputLoss(out);
 }
 
 double NeuralNetwork::loss(const vector<vector<double>*>& ins, const vector<vector<double>*>& outs)
@@ -135,39 +392,237 @@ void NeuralNetwork::shiftWeights(float percentage_of_range)
 }
 
 
-vector<double> NeuralNetwork::predict(const vector<double>& in)
+vector<double> NeuralNetwork::predict(const Row& in)
+{
+	setInput(in);
+	trigger();
+	return output();
+}
+
+vector<double> NeuralNetwork::predict(const SparseRow& in)
 {
 	setInput(in);
 	trigger();
 	return output();
 }
 
+vector<double> NeuralNetwork::predict(const Dataset& dataset, Datatype d, size_t i)
+{
+	if (dataset.isSparse())
+		return predict(dataset.getSparseIns(d)[i]);
+	return predict(dataset.getIns(d)[i]);
+}
+
 double NeuralNetwork::predictAllForScore(const Dataset& dataset, Datatype d,  int limit)
 {
 	if (limit == 0)
 		return 1;
 	double s = 0;
+	RowView outs = dataset.getOuts(d);
+	auto score = [&](size_t i) {
+		predict(dataset, d, i);
+		return outputLoss(outs[i]);
+	};
 
 	//Sans limite explicite, on score toutes les donn�es
 	if (limit == -1)
-		for (size_t i = 0; i < dataset.getIns(d).size(); i++)
-			s += distanceVector(predict(*dataset.getIns(d)[i]), *dataset.getOuts(d)[i]);
+		for (size_t i = 0; i < outs.size(); i++)
+			s += score(i);
 	//Sinon on prend "limit" donn�es
 	else
 		for (int i = 0; i < limit; i++)
 		{
-			int r = rand() % dataset.getIns(d).size();
-			s += distanceVector(predict(*dataset.getIns(d)[r]), *dataset.getOuts(d)[r]);
+			int r = rand() % outs.size();
+			s += score(r);
 		}
 
 	//On moyenne le score
 	if (limit == -1)
-		s /= dataset.getIns(d).size();
+		s /= outs.size();
 	else
 		s /= limit;
 	return s;
 }
 
+double NeuralNetwork::predictSubsetForScore(const Dataset& dataset, Datatype d, const vector<size_t>& ids)
+{
+	if (ids.size() == 0)
+		return 1;
+	double s = 0;
+	RowView outs = dataset.getOuts(d);
+	for (size_t i : ids)
+	{
+		predict(dataset, d, i);
+		s += outputLoss(outs[i]);
+	}
+	return s / ids.size();
+}
+
+void NeuralNetwork::setDirection(const vector<double>& direction)
+{
+	size_t k = 0;
+	for (size_t i_layer = 0; i_layer < _layers.size() - 1; ++i_layer)
+		for (Neuron* n : _layers[i_layer]->neurons())
+			for (Edge* e : n->_next)
+				e->setTangent(direction[k++]);
+}
+
+vector<double> NeuralNetwork::predictDirectional(const Row& in, vector<double>& tangent)
+{
+	setInput(in);
+	for (Layer* l : _layers)
+		l->triggerTangent();
+
+	tangent.resize(_layers.back()->neurons().size());
+	for (size_t i = 0; i < tangent.size(); i++)
+		tangent[i] = _layers.back()->neurons()[i]->outputTangent();
+	return output();
+}
+
+vector<double> NeuralNetwork::predictDirectional(const SparseRow& in, vector<double>& tangent)
+{
+	setInput(in);
+	_layers[0]->triggerTangentSparse(_active_inputs);
+	for (size_t i = 1; i < _layers.size(); ++i)
+		_layers[i]->triggerTangent();
+
+	tangent.resize(_layers.back()->neurons().size());
+	for (size_t i = 0; i < tangent.size(); i++)
+		tangent[i] = _layers.back()->neurons()[i]->outputTangent();
+	return output();
+}
+
+//Same sampling as predictAllForScore, so that with the same rand() seed both score the same data.
+//dscore receives the derivative of the score along the direction set by setDirection.
+double NeuralNetwork::predictAllForScoreDirectional(const Dataset& dataset, double& dscore, Datatype d, int limit)
+{
+	dscore = 0;
+	if (limit == 0)
+		return 1;
+	double s = 0;
+	vector<double> t;
+	RowView outs = dataset.getOuts(d);
+
+	size_t n = limit == -1 ? outs.size() : limit;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t r = limit == -1 ? i : rand() % outs.size();
+		if (dataset.isSparse())
+			predictDirectional(dataset.getSparseIns(d)[r], t);
+		else
+			predictDirectional(dataset.getIns(d)[r], t);
+		s += outputLoss(outs[r]);
+		//chain rule through the accumulated values of the output layer
+		Layer* out = _layers.back();
+		for (size_t j = 0; j < out->neurons().size(); j++)
+			dscore += out->_delta[j] * out->neurons()[j]->_accumulated_tangent;
+	}
+
+	s /= n;
+	dscore /= n;
+	return s;
+}
+
+vector<double> NeuralNetwork::scoreEdgeCandidates(Edge* e, const vector<double>& candidates, const Dataset& dataset, Datatype d, int limit)
+{
+	const size_t K = candidates.size();
+	vector<double> scores(K, 0);
+	if (K == 0 || limit == 0)
+		return scores;
+
+	Neuron* src = e->neuronb();
+	Neuron* dst = e->neuron();
+	size_t first = dst->_layer->getId(); //layer holding the only neuron whose input depends on the edge
+
+	//lanes: value of neuron i for candidate k is at [i*K + k]
+	vector<double> lanes, next, z, dout(K), loss_workspace;
+	RowView outs = dataset.getOuts(d);
+
+	size_t n = limit == -1 ? outs.size() : limit;
+	for (size_t s = 0; s < n; s++)
+	{
+		size_t r = limit == -1 ? s : rand() % outs.size();
+		predict(dataset, d, r); //baseline values, valid for every layer up to 'first'
+
+		//layer 'first': only dst changes, its accumulated value moves by (c - w) * src output
+		double so = src->output();
+		Row target = outs[r];
+		const Loss& loss = getLoss();
+		if (first == _layers.size() - 1)
+		{
+			z.clear();
+			for (Neuron* ne : dst->_layer->neurons())
+				z.push_back(ne->in());
+			double zd = z[dst->getNeuronId()];
+			for (size_t k = 0; k < K; k++)
+			{
+				z[dst->getNeuronId()] = zd + (candidates[k] - e->weight()) * so;
+				scores[k] += loss.evaluate(z.data(), target.data(), nullptr, 1, z.size(), loss_workspace);
+			}
+			continue;
+		}
+
+		double base = dst->output();
+		for (size_t k = 0; k < K; k++)
+			dout[k] = dst->activate(dst->in() + (candidates[k] - e->weight()) * so) - base;
+
+		//layer 'first' + 1: baseline accumulation plus the change coming through dst
+		Layer* l = _layers[first + 1];
+		lanes.assign(l->neurons().size() * K, 0);
+		for (size_t i = 0; i < l->neurons().size(); i++)
+			for (size_t k = 0; k < K; k++)
+				lanes[i * K + k] = l->neurons()[i]->in();
+		for (Edge* de : dst->_layer->nextEdges(dst->getNeuronId()))
+		{
+			double w = de->weight();
+			double* a = &lanes[de->neuron()->getNeuronId() * K];
+			for (size_t k = 0; k < K; k++)
+				a[k] += w * dout[k];
+		}
+
+		//remaining hidden layers, all lanes at once
+		for (size_t i_layer = first + 1; i_layer + 1 < _layers.size(); i_layer++)
+		{
+			l = _layers[i_layer];
+			for (size_t i = 0; i < l->neurons().size(); i++)
+			{
+				Neuron* ne = l->neurons()[i];
+				double* a = &lanes[i * K];
+				for (size_t k = 0; k < K; k++)
+					a[k] = ne->isBias() ? 1 : ne->activate(a[k]);
+			}
+
+			next.assign(_layers[i_layer + 1]->neurons().size() * K, 0);
+			for (size_t i = 0; i < l->neurons().size(); i++)
+			{
+				const double* o = &lanes[i * K];
+				for (Edge* ne : l->nextEdges(i))
+				{
+					double w = ne->weight();
+					double* a = &next[ne->neuron()->getNeuronId() * K];
+					for (size_t k = 0; k < K; k++)
+						a[k] += w * o[k];
+				}
+			}
+			swap(lanes, next);
+		}
+
+		//lanes hold the accumulated values of the output layer, the loss applies its activation
+		size_t n_out = _layers.back()->neurons().size();
+		z.resize(n_out);
+		for (size_t k = 0; k < K; k++)
+		{
+			for (size_t i = 0; i < n_out; i++)
+				z[i] = lanes[i * K + k];
+			scores[k] += loss.evaluate(z.data(), target.data(), nullptr, 1, n_out, loss_workspace);
+		}
+	}
+
+	for (size_t k = 0; k < K; k++)
+		scores[k] /= n;
+	return scores;
+}
+
 vector<Layer*> NeuralNetwork::getLayers()
 {
 	return _layers;
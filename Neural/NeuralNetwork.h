@@ -3,7 +3,9 @@
 
 #include "../misc/functions.h"
 #include "layer.h"
+#include "loss.h"
 #include "../dataset/dataset.h"
+#include <memory>
 #include <unordered_map>
 
 #define RAND_MAX_WEIGHT 1
@@ -30,11 +32,25 @@ public:
 
 	void autogenerate(bool randomize = true);
 
+	//New network with the same layers, edges and weights (caller owns it)
+	NeuralNetwork* clone();
+
 	void addLayer(unordered_map<string, double> parameters);
 
+	//Text model file: one line of layer parameters per layer, then the flat weights (pruned ones are zeros, the
+	//mask itself is not saved)
+	bool save(const string& filename);
+
+	//Builds the layers and weights of a saved model into this (empty) network. Binary models (see FlatNetwork) are
+	//recognized too
+	bool load(const string& filename);
+
     void clean();
 
-	void setInput(vector<double> in);
+	void setInput(const Row& in);
+
+	//Sparse input: only the nonzero input neurons are written, and only they propagate in trigger()
+	void setInput(const SparseRow& in);
 
     void trigger();
 
@@ -52,9 +68,48 @@ public:
 
 	vector<vector<vector<Edge*> > > getEdges();
 
+	//All the weights in one flat vector, in getEdges() order
+	vector<double> getFlatWeights();
+
+	void setFlatWeights(const vector<double>& weights);
+
+	void setFlatWeights(const double* weights);
+
     void randomizeAllWeights();
 
-    double loss(const vector<double>& in, const vector<double>& out);
+	//Magnitude pruning: in every layer, masks the smallest non-bias edges (see Edge::prune) until the given fraction
+	//of them is pruned. The edges stay in the network, so the objects holding them remain valid, and the weight
+	//count does not change. Bias edges are kept. Returns the number of edges pruned by this call.
+	size_t prune(double sparsity);
+
+	//fraction of the non-bias edges that are pruned
+	double sparsity();
+
+	//one flag per weight, in getFlatWeights order (1 = pruned)
+	vector<char> getPruneMask();
+
+	//prunes the flagged edges
+	void setPruneMask(const vector<char>& mask);
+
+	//Rebuilds the lists of unpruned edges of the layers with more than FLAT_SPARSE_THRESHOLD of their edges pruned
+	//(see Layer::_sparse_next): the forward and backward passes through those layers only visit the listed edges.
+	//Called by prune and setPruneMask; after pruning single edges (Edge::prune), call it before training again
+	void updateSparse();
+
+	//Loss used by the scores and the backpropagation. MSE by default, CROSS_ENTROPY when the last layer is SOFTMAX
+	void setLoss(LossFunction f);
+
+	const Loss& getLoss();
+
+	//loss of the current outputs (after predict) for the target. Also leaves the error terms of the output layer
+	//in its _delta
+	double outputLoss(const Row& target);
+
+	//Precision of the sigmoid neurons (see functions.h). The approximations suit inference and noisy scoring,
+	//the loss keeps the exact output activation
+	void setActivationMode(ActivationMode mode);
+
+    double loss(const Row& in, const Row& out);
 
 	double loss(const vector<vector<double>*>& ins, const vector<vector<double>*>& outs);
 
@@ -62,12 +117,33 @@ public:
 
 	void shiftWeights(float percentage_of_range);
 
-	vector<double> predict(const vector<double>& in);
+	vector<double> predict(const Row& in);
+
+	vector<double> predict(const SparseRow& in);
+
+	//sample i of a split, through the sparse input path for sparse datasets
+	vector<double> predict(const Dataset& dataset, Datatype d, size_t i);
 
 	double predictAllForScore(const Dataset& dataset, Datatype d = TEST, int limit=-1);
 
 	double predictPartialForScore(const Dataset& dataset);
 
+	//Mean score over the given sample indices
+	double predictSubsetForScore(const Dataset& dataset, Datatype d, const vector<size_t>& ids);
+
+	//Forward-mode (directional derivative) pass. The direction holds one value per edge, in getEdges() order
+	void setDirection(const vector<double>& direction);
+
+	vector<double> predictDirectional(const Row& in, vector<double>& tangent);
+
+	vector<double> predictDirectional(const SparseRow& in, vector<double>& tangent);
+
+	double predictAllForScoreDirectional(const Dataset& dataset, double& dscore, Datatype d = TEST, int limit = -1);
+
+	//Scores every candidate value of one edge weight on the same samples in a single pass: only the layers
+	//downstream of the edge are recomputed, with the candidates laid out as contiguous lanes
+	vector<double> scoreEdgeCandidates(Edge* e, const vector<double>& candidates, const Dataset& dataset, Datatype d = TRAIN, int limit = -1);
+
 	vector<Layer*> getLayers();
 
 
@@ -78,7 +154,16 @@ public:
     vector<Layer*> _layers;
 	double _fitness;
 
+	vector<uint> _active_inputs; //nonzero inputs of the last sparse input
+	bool _sparse_input = false;
+
 	vector<unordered_map<string,double> > _configuration;
+
+	unique_ptr<Loss> _loss; //built from the last layer when first needed
+	LossFunction _loss_function = LossFunction::MSE;
+	bool _default_loss = true;
+
+	ActivationMode _activation_mode = ActivationMode::EXACT_ACTIVATION;
 };
 
 #endif // NEURALNETWORK_H
\ No newline at end of file
@@ -19,9 +19,22 @@ Neuron::~Neuron(){
 } // Destructor for the class
 
 void Neuron::trigger(){
-    for(Edge* e : _next){
-        e->propagate(output());
-    } // Propagates information from this neuron to its connected edges.
+    EdgeRange edges = _layer->nextEdges(_id_neuron);
+    if(edges.begin() == edges.end()){
+        return;
+    }
+    double o = output();
+    for(Edge* e : edges){
+        e->propagate(o);
+    } // Propagates information from this neuron to its connected edges (the unpruned ones in a sparse layer).
+}
+
+void Neuron::triggerTangent(){
+    double o = output();
+    double t = outputTangent();
+    for(Edge* e : _layer->nextEdges(_id_neuron)){
+        e->propagateTangent(o, t);
+    }
 }
 
 double Neuron::in(){
@@ -43,17 +56,25 @@ double Neuron::output(){
         */
     }
 
+    if(_layer->getType() == LayerType::SOFTMAX){
+        return _layer->_softmax[_id_neuron];
+    }
+
     //return random(-10, 10);
+	return activate(_accumulated);
+}
+
+double Neuron::activate(double x) const{
 	if (_activation_function == ActivationFunction::LINEAR){
-        return _accumulated;
+        return x;
     }
 	if(_activation_function == ActivationFunction::RELU){
-        return relu(_accumulated);
+        return relu(x);
     }
 	if (_activation_function == ActivationFunction::SIGMOID){
-        return sigmoid(_accumulated);
+        return sigmoid(x, _layer->getNet()->_activation_mode);
     }
-	return outputRaw();
+	return x;
 }
 
 double Neuron::outputDerivative(){
@@ -64,7 +85,8 @@ double Neuron::outputDerivative(){
         return relu_derivative(output());
     }
     if(_activation_function == ActivationFunction::SIGMOID){
-        return sigmoid_derivative(outputRaw());
+        double o = output(); // sigmoid' = s (1 - s), from the output instead of two more exp
+        return o * (1 - o);
     }
     return _accumulated;
 }
@@ -73,8 +95,20 @@ double Neuron::outputRaw(){
     return _accumulated;
 }
 
+double Neuron::outputTangent(){
+    // Inputs and bias neurons do not depend on the weights
+    if(_is_bias || _layer->getType() == LayerType::INPUT){
+        return 0;
+    }
+    if(_layer->getType() == LayerType::SOFTMAX){
+        return _layer->_softmax_tangent[_id_neuron];
+    }
+    return outputDerivative() * _accumulated_tangent;
+}
+
 void Neuron::clean(){
     setAccumulated(0);
+    _accumulated_tangent = 0;
 }
 
 void Neuron::addAccumulated(double v){
@@ -83,6 +117,10 @@ void Neuron::addAccumulated(double v){
     setAccumulated(_accumulated + v);
 }
 
+void Neuron::addAccumulatedTangent(double v){
+    _accumulated_tangent += v;
+}
+
 void Neuron::addNext(Neuron *n){
     _next.push_back(new Edge(n, this, random(-5, 5)));
 	n->addPrevious(_next.back());
@@ -157,62 +195,58 @@ void Neuron::shiftWeights(float range){
 }
 
 void Neuron::shiftBackWeights(const vector<double>& w){
+	if (_layer->_sparse_previous){
+		for (size_t k = _layer->_previous_ptr[_id_neuron]; k < _layer->_previous_ptr[_id_neuron + 1]; k++)
+			_previous[_layer->_previous_index[k]]->shiftWeight(w[_layer->_previous_index[k]]);
+		return;
+	}
 	for (size_t i = 0; i < _previous.size(); i++)
 		_previous[i]->shiftWeight(w[i]);
 }
 
 //gradient descent
-vector<double> Neuron::getBackpropagationShifts(const vector<double>& target){
-	vector<double> dw(_previous.size(),0);
-    // This line declares a local vector called dw and initializes it with zeros. 
-    // The size of this vector is set to _previous.size(), which is the number of incoming edges to the neuron.
-	if (_layer->getType() == LayerType::OUTPUT){
-    // This conditional statement checks if the layer to which the neuron belongs is of type LayerType::OUTPUT. 
-    // If it is, it executes the code inside the if block.
-		double d0 = output(); // Computes and stores the output of the neuron.
-		double d1 = output() - target[this->getNeuronId()]; // Computes the difference between the neuron's output and the target output specified by the target vector.
-		double d2 = outputDerivative(); // Computes the derivative of the neuron's output.
-		for (size_t i = 0; i < _previous.size(); ++i){
-            /*
-                A loop iterates over the _previous vector (incoming edges) and computes adjustments (dw[i]) to their weights
-                based on the values of d1, d2, and the output of the connected neurons.
-            */
-			dw[i] = (-d1*d2*_previous[i]->neuronb()->output());
-			_previous[i]->setBackpropagationMemory(d1*d2);
-            // The backpropagation memory of each incoming edge is updated using setBackpropagationMemory()
-		}
-		//cout << _layer->getId() << " " << d1 << " " << d2 << " " << d3 << " " << d1*d2*d3 << endl;
-
-	}
-	else 
-	{
-		double d = 0;
-		for (size_t i = 0; i < _next.size(); i++){
-            d += _next[i]->backpropagationMemory() * _next[i]->weight();
-        }
-        /*
-            A loop iterates over the _next vector (outgoing edges) and accumulates the product of each edge's 
-            backpropagation memory and weight.
+vector<double> Neuron::getBackpropagationShifts(){
+	vector<double> dw(_previous.size(), 0);
+    // One shift per incoming edge, in _previous order.
+	addBackpropagationShifts(dw);
+	return dw;
+}
 
-            Backpropagation is a supervised learning algorithm used for training neural networks. During training, 
-            the network computes an output based on the input data, and then it compares this output to the desired target output. 
-            Any difference between the actual and target outputs is called an error or loss.
-        */
-			
-		d *= outputDerivative();
-        // The accumulated value d is then multiplied by the derivative of the neuron's output.
-		for (size_t i = 0; i < _previous.size(); i++){
-			_previous[i]->setBackpropagationMemory(d);
-			dw[i] = -d * _previous[i]->neuronb()->output();
+void Neuron::addBackpropagationShifts(vector<double>& dw){
+	if (_previous.empty())
+		return;
+	double d = getBackpropagationDelta();
+    /*
+        Error term of the neuron: computed for the whole output layer by the loss of the network (see Layer::outputDelta),
+        or accumulated from the next layer for hidden neurons.
+    */
+	if (_layer->_sparse_previous){
+		for (size_t k = _layer->_previous_ptr[_id_neuron]; k < _layer->_previous_ptr[_id_neuron + 1]; k++){
+			Edge* e = _previous[_layer->_previous_index[k]];
+			e->setBackpropagationMemory(d);
+			dw[_layer->_previous_index[k]] -= d * e->neuronb()->output();
 		}
-        /*
-            Another loop iterates over the _previous vector (incoming edges) and computes adjustments (dw[i]) to their weights 
-            based on the value of d and the output of the connected neurons.
+		return;
+	} // Pruned edges keep a zero shift
+	for (size_t i = 0; i < _previous.size(); i++){
+		_previous[i]->setBackpropagationMemory(d);
+		dw[i] -= d * _previous[i]->neuronb()->output();
+	}
+    /*
+        The shift of each incoming edge depends on d and the output of the neuron it comes from.
+        The backpropagation memory of the edge keeps d, read back by the previous layer.
+    */
+}
 
-            The backpropagation memory of each incoming edge is updated using setBackpropagationMemory()
-        */
+double Neuron::getBackpropagationDelta(){
+	if (_layer->getType() == LayerType::OUTPUT || _layer->getType() == LayerType::SOFTMAX){
+		return _layer->_delta[_id_neuron];
 	}
-	return dw;
+	double d = 0;
+	for (Edge* e : _layer->nextEdges(_id_neuron)){
+		d += e->backpropagationMemory() * e->weight();
+	}
+	return d * outputDerivative();
 }
 
 bool Neuron::isBias() const{
@@ -50,6 +50,9 @@ class Neuron{
 
         void trigger();
 
+        void triggerTangent();
+        // Forward-mode version of trigger(): also propagates the directional derivative of the output
+
         double in();
 
         double output();
@@ -58,10 +61,17 @@ class Neuron{
 
 	        double outputRaw();
 
+	        double outputTangent();
+
+	        double activate(double x) const;
+	        // Activation function of this neuron applied to an arbitrary accumulated value
+
         void clean();
 
         void addAccumulated(double v);
 
+            void addAccumulatedTangent(double v);
+
             void addNext(Neuron* n);
 
 	        void addPrevious(Edge* e);
@@ -84,7 +94,13 @@ class Neuron{
 
 	        void shiftBackWeights(const vector<double>& range);
 
-	        vector<double> getBackpropagationShifts(const vector<double>& target);
+	        vector<double> getBackpropagationShifts();
+
+	        void addBackpropagationShifts(vector<double>& dw);
+	        // Adds the shifts of getBackpropagationShifts to dw (one per _previous edge), only for the unpruned edges once the previous layer is sparse
+
+	        double getBackpropagationDelta();
+	        // Only the error term of getBackpropagationShifts (d, what the incoming edges memorize), without the per edge shifts
 
 	        bool isBias() const;
 
@@ -92,6 +108,7 @@ class Neuron{
         Layer* _layer = NULL;
         int _id_neuron = 0;
         double _accumulated = 0.0;
+        double _accumulated_tangent = 0.0; // directional derivative of _accumulated (forward mode)
 
             double _threshold = 0.0;
 	        vector<Edge*> _next;
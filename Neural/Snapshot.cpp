@@ -0,0 +1,120 @@
+#include "snapshot.h"
+#include "edge.h"
+
+
+size_t WeightSnapshot::version() const
+{
+	return _version;
+}
+
+size_t WeightSnapshot::size() const
+{
+	return _size;
+}
+
+double WeightSnapshot::weight(size_t i) const
+{
+	return (*(*_pages)[i / _page_size])[i % _page_size];
+}
+
+vector<double> WeightSnapshot::values() const
+{
+	vector<double> v;
+	v.reserve(_size);
+	for (size_t p = 0; _pages && p < _pages->size(); p++)
+		v.insert(v.end(), (*_pages)[p]->begin(), (*_pages)[p]->end());
+	v.resize(_size);
+	return v;
+}
+
+bool WeightSnapshot::empty() const
+{
+	return !_pages;
+}
+
+
+SnapshotStore::SnapshotStore(NeuralNetwork* n, size_t page_size) : _n(n), _page_size(max(page_size, size_t(1)))
+{
+	for (auto& layer : n->getEdges())
+		for (auto& neuron : layer)
+			_edges.insert(_edges.end(), neuron.begin(), neuron.end());
+	size_t n_pages = (_edges.size() + _page_size - 1) / _page_size;
+	_dirty.assign(n_pages, 1); //nothing copied yet
+	for (size_t i = 0; i < _edges.size(); i++)
+		_edges[i]->_dirty = &_dirty[i / _page_size];
+
+	_last._page_size = _page_size;
+	_last._size = _edges.size();
+	_last._pages = make_shared<const WeightSnapshot::PageTable>(n_pages);
+}
+
+SnapshotStore::~SnapshotStore()
+{
+	for (Edge* e : _edges)
+		e->_dirty = nullptr;
+}
+
+WeightSnapshot SnapshotStore::snapshot()
+{
+	bool changed = false;
+	for (char d : _dirty)
+		changed |= d != 0;
+	if (!changed)
+		return _last;
+
+	//new page table: the clean pages are shared with the previous snapshot
+	auto pages = make_shared<WeightSnapshot::PageTable>(*_last._pages);
+	for (size_t p = 0; p < _dirty.size(); p++)
+	{
+		if (!_dirty[p])
+			continue;
+		size_t first = p * _page_size;
+		size_t last = min(first + _page_size, _edges.size());
+		auto page = make_shared<vector<double> >(last - first);
+		for (size_t i = first; i < last; i++)
+			(*page)[i - first] = _edges[i]->weight();
+		(*pages)[p] = page;
+		_dirty[p] = 0;
+		_copied_pages++;
+	}
+	_last._pages = pages;
+	_last._version = ++_version;
+	return _last;
+}
+
+void SnapshotStore::restore(const WeightSnapshot& s)
+{
+	const WeightSnapshot::PageTable& target = *s._pages;
+	const WeightSnapshot::PageTable& current = *_last._pages;
+	for (size_t p = 0; p < target.size(); p++)
+	{
+		if (!_dirty[p] && current[p] == target[p])
+			continue;
+		size_t first = p * _page_size;
+		for (size_t i = first; i < min(first + _page_size, _edges.size()); i++)
+			_edges[i]->alterWeight((*target[p])[i - first]);
+		_dirty[p] = 0;
+	}
+	_last = s;
+}
+
+vector<pair<size_t, double> > SnapshotStore::diff(const WeightSnapshot& a, const WeightSnapshot& b)
+{
+	vector<pair<size_t, double> > d;
+	for (size_t p = 0; p < a._pages->size(); p++)
+	{
+		const auto& pa = (*a._pages)[p];
+		const auto& pb = (*b._pages)[p];
+		if (pa == pb)
+			continue;
+		for (size_t i = 0; i < pa->size(); i++)
+			if ((*pa)[i] != (*pb)[i])
+				d.push_back({ p * a._page_size + i, (*pb)[i] - (*pa)[i] });
+	}
+	return d;
+}
+
+size_t SnapshotStore::copiedPages() const
+{
+	return _copied_pages;
+}
@@ -0,0 +1,69 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "neuralnetwork.h"
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+class SnapshotStore;
+
+//Weights of a network at one point in time, in getEdges() order, split in fixed size pages.
+//Pages are immutable and shared between snapshots, copying a snapshot only copies a pointer.
+class WeightSnapshot
+{
+public:
+	size_t version() const;
+
+	size_t size() const;
+
+	double weight(size_t i) const;
+
+	//all the weights, in getFlatWeights() order
+	vector<double> values() const;
+
+	bool empty() const;
+
+private:
+	friend class SnapshotStore;
+	typedef vector<shared_ptr<const vector<double> > > PageTable;
+
+	size_t _version = 0;
+	size_t _page_size = 0;
+	size_t _size = 0;
+	shared_ptr<const PageTable> _pages;
+};
+
+//Copy-on-write snapshots of the weights of one network.
+//Every Edge of the network flags its page as dirty when its weight changes, so snapshot() copies only the pages
+//changed since the previous snapshot and shares the others, and restore() writes back only the pages that differ.
+//The network must keep its edges while the store exists, and only one store can be attached to a network.
+class SnapshotStore
+{
+public:
+	SnapshotStore(NeuralNetwork* n, size_t page_size = 512);
+
+	~SnapshotStore();
+
+	WeightSnapshot snapshot();
+
+	void restore(const WeightSnapshot& s);
+
+	//(index, b - a) of every weight that differs, pages shared by both are skipped
+	static vector<pair<size_t, double> > diff(const WeightSnapshot& a, const WeightSnapshot& b);
+
+	//pages copied by the snapshots so far (a full copy counts all the pages)
+	size_t copiedPages() const;
+
+private:
+	NeuralNetwork* _n;
+	size_t _page_size;
+	vector<Edge*> _edges;
+	vector<char> _dirty;
+	WeightSnapshot _last; //what the network holds, except for the dirty pages
+	size_t _version = 0;
+	size_t _copied_pages = 0;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,187 @@
+#include "allreduce.h"
+
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+static string sharedName(const string& name)
+{
+	return name.size() && name[0] == '/' ? name : "/" + name;
+}
+
+//header, then one cache line of progress per rank, then the buffers
+size_t ShmAllreduce::segmentSize(size_t ranks, size_t size)
+{
+	return 64 + ranks * sizeof(Progress) + ranks * size * sizeof(double);
+}
+
+bool ShmAllreduce::create(const string& name, size_t ranks, size_t size)
+{
+#ifndef _WIN32
+	if (ranks == 0)
+		return false;
+	size_t bytes = segmentSize(ranks, size);
+	int fd = shm_open(sharedName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0)
+	{
+		cerr << "cannot create shared memory " << name << endl;
+		return false;
+	}
+	void* p = ftruncate(fd, bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (p == MAP_FAILED)
+	{
+		shm_unlink(sharedName(name).c_str());
+		return false;
+	}
+
+	char* data = static_cast<char*>(p);
+	Header* h = new (data) Header();
+	h->ranks = ranks;
+	h->size = size;
+	h->aborted.store(0);
+	for (size_t r = 0; r < ranks; r++)
+		new (data + 64 + r * sizeof(Progress)) Progress{ { 0 } };
+	atomic_thread_fence(memory_order_release);
+	memcpy(h->magic, ALLREDUCE_MAGIC, sizeof(h->magic));
+	munmap(p, bytes);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool ShmAllreduce::unlink(const string& name)
+{
+#ifndef _WIN32
+	return shm_unlink(sharedName(name).c_str()) == 0;
+#else
+	return false;
+#endif
+}
+
+ShmAllreduce::ShmAllreduce(const string& name, size_t rank) :
+	_rank(rank)
+{
+#ifndef _WIN32
+	int fd = shm_open(sharedName(name).c_str(), O_RDWR, 0);
+	if (fd < 0)
+		return;
+	struct stat st;
+	void* p = fstat(fd, &st) == 0 && size_t(st.st_size) >= 64 ?
+		mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (p == MAP_FAILED)
+		return;
+
+	Header* h = static_cast<Header*>(p);
+	if (memcmp(h->magic, ALLREDUCE_MAGIC, sizeof(h->magic)) != 0 || rank >= h->ranks
+		|| segmentSize(h->ranks, h->size) > size_t(st.st_size))
+	{
+		munmap(p, st.st_size);
+		return;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	_header = h;
+	_mapped = st.st_size;
+	_progress = reinterpret_cast<Progress*>(static_cast<char*>(p) + 64);
+	_data = reinterpret_cast<double*>(_progress + h->ranks);
+	_steps = _progress[rank].steps.load();
+#endif
+}
+
+ShmAllreduce::~ShmAllreduce()
+{
+#ifndef _WIN32
+	if (_header)
+		munmap(_header, _mapped);
+#endif
+}
+
+bool ShmAllreduce::isOpen() const
+{
+	return _header != nullptr;
+}
+
+size_t ShmAllreduce::rank() const
+{
+	return _rank;
+}
+
+size_t ShmAllreduce::ranks() const
+{
+	return _header ? _header->ranks : 0;
+}
+
+void ShmAllreduce::abort()
+{
+	if (_header)
+		_header->aborted.store(1);
+}
+
+double* ShmAllreduce::buffer(size_t rank)
+{
+	return _data + rank * _header->size;
+}
+
+bool ShmAllreduce::waitFor(size_t rank, uint64_t steps)
+{
+	for (size_t spins = 0; _progress[rank].steps.load(memory_order_acquire) < steps; spins++)
+	{
+		if (_header->aborted.load(memory_order_relaxed))
+			return false;
+		if (spins >= ALLREDUCE_SPINS)
+			this_thread::yield();
+	}
+	return !_header->aborted.load(memory_order_relaxed);
+}
+
+//Step k of a call (k = 0 writes the input) starts when the predecessor has done k steps (its chunk is ready) and
+//the successor too (it has read everything this step overwrites)
+bool ShmAllreduce::allreduce(double* v, size_t offset, size_t n)
+{
+	if (!_header || offset + n > _header->size)
+		return false;
+	const size_t R = _header->ranks;
+	if (R == 1)
+		return true;
+	const size_t prev = (_rank + R - 1) % R, next = (_rank + 1) % R;
+	double* mine = buffer(_rank) + offset;
+	const double* theirs = buffer(prev) + offset;
+	auto chunk = [&](size_t c, size_t& begin, size_t& end) {
+		begin = n * c / R;
+		end = n * (c + 1) / R;
+	};
+
+	for (size_t k = 0; k < 2 * R - 1; k++)
+	{
+		if (!waitFor(prev, _steps) || !waitFor(next, _steps))
+			return false;
+		size_t begin, end;
+		if (k == 0)
+			memcpy(mine, v, n * sizeof(double));
+		else if (k < R) //reduce-scatter: chunk rank - k gets the predecessor's partial sum
+		{
+			chunk((_rank + R - k) % R, begin, end);
+			for (size_t i = begin; i < end; i++)
+				mine[i] += theirs[i];
+		}
+		else //allgather: chunk rank - (k - R) is complete at the predecessor
+		{
+			chunk((_rank + 2 * R - k) % R, begin, end);
+			memcpy(mine + begin, theirs + begin, (end - begin) * sizeof(double));
+		}
+		_progress[_rank].steps.store(++_steps, memory_order_release);
+	}
+	memcpy(v, mine, n * sizeof(double));
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#define ALLREDUCE_MAGIC "NNRING1"
+#define ALLREDUCE_SPINS 256 //busy polls before yielding the CPU
+
+using namespace std;
+
+//Sum of a vector over the processes of one host, through a named POSIX shared memory segment holding one buffer
+//per rank. Chunked ring: the range is cut in one chunk per rank, then N - 1 reduce-scatter steps and N - 1
+//allgather steps, where each rank only reads a chunk of its predecessor's buffer. A per-rank step counter
+//orders the steps: a rank waits for its predecessor (the data it reads) and for its successor (which must be done
+//reading what it overwrites), so no barrier is needed.
+class ShmAllreduce
+{
+public:
+	//creates the segment for ranks buffers of size doubles (before the ranks start)
+	static bool create(const string& name, size_t ranks, size_t size);
+
+	static bool unlink(const string& name);
+
+	ShmAllreduce(const string& name, size_t rank);
+
+	~ShmAllreduce();
+
+	bool isOpen() const;
+
+	size_t rank() const;
+
+	size_t ranks() const;
+
+	//In place sum over the ranks of v = [offset, offset + n) of the buffer space. Every rank must make the same
+	//calls in the same order. False once the segment is aborted (a rank died), the values are then undefined.
+	bool allreduce(double* v, size_t offset, size_t n);
+
+	//wakes every rank waiting in allreduce with a failure, for good
+	void abort();
+
+private:
+	struct Header
+	{
+		char magic[8];
+		uint64_t ranks;
+		uint64_t size;
+		atomic<uint32_t> aborted;
+	};
+
+	struct alignas(64) Progress
+	{
+		atomic<uint64_t> steps; //steps done by the rank, over every call
+	};
+
+	static size_t segmentSize(size_t ranks, size_t size);
+
+	bool waitFor(size_t rank, uint64_t steps);
+
+	double* buffer(size_t rank);
+
+	Header* _header = nullptr;
+	Progress* _progress = nullptr;
+	double* _data = nullptr;
+	size_t _mapped = 0;
+	size_t _rank = 0;
+	uint64_t _steps = 0;
+};
@@ -11,61 +11,142 @@ void Backpropagation::setBatchSize(size_t bs)
 	_batch_size = bs;
 }
 
+double Backpropagation::batchLoss() const
+{
+	return _batch_loss;
+}
+
+void Backpropagation::setGradientExchange(GradientExchange* exchange)
+{
+	_exchange = exchange;
+}
+
 void Backpropagation::minimize()
 {
-	vector<const vector<double>*> batch_in(_batch_size);
-	vector<const vector<double>*> batch_out(_batch_size);
+	vector<Row> batch_in;
+	vector<Row> batch_out;
 
-	for (size_t i = 0; i < _batch_size; i++)
+	if (_d->isSparse())
 	{
-		int z = rand() % _d->getIns(TRAIN).size();
-		batch_in[i] = _d->getIns(TRAIN)[z];
-		batch_out[i] = _d->getOuts(TRAIN)[z];
+		vector<SparseRow> sparse_in;
+		_d->getSparseBatch(TRAIN, _batch_size, sparse_in, batch_out);
+		backpropagate(sparse_in, batch_out);
+		return;
 	}
+	_d->getBatch(TRAIN, _batch_size, batch_in, batch_out);
 	backpropagate(batch_in, batch_out);
 }
 
 
-vector<vector<vector<double>>> Backpropagation::getBackpropagationShifts(const vector<double>& in, const vector<double>& out)
+vector<vector<vector<double>>> Backpropagation::getBackpropagationShifts(const Row& in, const Row& out)
 {
 	vector<vector<vector<double>>> dw(_n->getLayers().size());
 	auto out_exp = _n->predict(in);
 	for (int i = _n->getLayers().size() - 1; i >= 1; --i)
 	{
-		auto _dw = move(_n->getLayers()[i]->getBackpropagationShifts(out));
+		double loss = 0;
+		auto _dw = move(_n->getLayers()[i]->getBackpropagationShifts(out, &loss));
+		_batch_loss += loss;
 		dw[_n->getLayers()[i]->getId()] = _dw;
 	}
 	return move(dw);
 
 }
 
-void  Backpropagation::backpropagate(const vector<const vector<double>*>& ins, const vector<const vector<double>*>& outs)
+//Applies f to the shifts of the edges into layer l ([neuron][incoming edge]): all of them, or only the unpruned
+//ones once it is sparse (the others stay 0)
+template <class F>
+static void forEachShift(Layer* l, vector<vector<double> >& dw, F f)
 {
-	vector<vector<vector<double>>> dw(_n->getLayers().size());
-	bool is_init = false;
+	for (size_t k = 0; k < dw.size(); k++)
+		if (l->_sparse_previous)
+			for (size_t p = l->_previous_ptr[k]; p < l->_previous_ptr[k + 1]; p++)
+				f(dw[k][l->_previous_index[p]]);
+		else
+			for (double& x : dw[k])
+				f(x);
+}
+
+//The shifts of a layer are complete once the last sample went through it: they go to the exchange right away,
+//while the remaining layers of that sample are computed
+void  Backpropagation::backpropagate(const vector<Row>& ins, const vector<Row>& outs)
+{
+	vector<Layer*> layers = _n->getLayers();
+	vector<vector<vector<double>>> dw(layers.size());
+	for (size_t j = 1; j < layers.size(); j++)
+	{
+		dw[j].resize(layers[j]->neurons().size());
+		for (size_t k = 0; k < dw[j].size(); k++)
+			dw[j][k].resize(layers[j]->neurons()[k]->_previous.size(), 0);
+	}
+	_batch_loss = 0;
 	for (size_t i = 0; i < ins.size(); i++)
 	{
-		auto in = ins[i];
-		auto out = outs[i];
-		auto _dw = getBackpropagationShifts(*in, *out);
-		if (!is_init)
+		_n->predict(ins[i]);
+		for (size_t j = layers.size() - 1; j >= 1; --j)
 		{
-			for (size_t j = 0; j < _dw.size(); j++)
-			{
-				dw[j].resize(_dw[j].size());
-				for (size_t k = 0; k < _dw[j].size(); k++)
-					dw[j][k].resize(_dw[j][k].size(), 0);
-			}
+			double loss = 0;
+			layers[j]->addBackpropagationShifts(outs[i], dw[j], &loss); //edge l, neuron k, layer j
+			_batch_loss += loss;
+			if (i + 1 < ins.size())
+				continue;
+
+			forEachShift(layers[j], dw[j], [&](double& x) { x /= ins.size(); });
+			if (_exchange)
+				_exchange->submit(j, dw[j]);
 		}
-		for (size_t j = 0; j < _dw.size(); j++)
-			for (size_t k = 0; k < _dw[j].size(); k++)
-				for (size_t l = 0; l < _dw[j][k].size(); l++)
-					dw[j][k][l] += _dw[j][k][l]; //edge l, neuron k, layer j
 	}
-	for (size_t j = 0; j < dw.size(); j++)
+	_batch_loss /= ins.size();
+
+	if (_exchange && !_exchange->wait())
+		return;
+	_n->shiftBackWeights(dw);
+}
+
+void Backpropagation::backpropagate(const vector<SparseRow>& ins, const vector<Row>& outs)
+{
+	vector<Layer*> layers = _n->getLayers();
+	vector<vector<vector<double>>> dw(layers.size());
+	for (size_t j = 2; j < layers.size(); j++)
+	{
+		dw[j].resize(layers[j]->neurons().size());
 		for (size_t k = 0; k < dw[j].size(); k++)
-			for (size_t l = 0; l < dw[j][k].size(); l++)
-				dw[j][k][l] /= ins.size();
+			dw[j][k].resize(layers[j]->neurons()[k]->_previous.size(), 0);
+	}
+	unordered_map<Edge*, double> dw_first; //shifts of the edges leaving nonzero inputs
+	vector<double> delta;
+	_batch_loss = 0;
+	for (size_t i = 0; i < ins.size(); i++)
+	{
+		_n->predict(ins[i]);
+		if (layers.size() == 2) //layer 1 is the output layer, handled below
+			_batch_loss += layers[1]->outputDelta(outs[i]);
+
+		//layers 2.. : dense, as in backpropagate
+		for (size_t j = layers.size() - 1; j >= 2; --j)
+		{
+			double loss = 0;
+			layers[j]->addBackpropagationShifts(outs[i], dw[j], &loss);
+			_batch_loss += loss;
+		}
 
+		//layer 1: deltas of its neurons, then only the edges leaving the nonzero inputs and the bias
+		delta.assign(layers[1]->neurons().size(), 0);
+		for (Neuron* n : layers[1]->neurons())
+			if (!n->isBias())
+				delta[n->getNeuronId()] = n->getBackpropagationDelta();
+		for (size_t k = 0; k < ins[i].nnz(); k++)
+			for (Edge* e : layers[0]->nextEdges(ins[i].indices()[k]))
+				dw_first[e] -= delta[e->neuron()->getNeuronId()] * ins[i].values()[k];
+		for (Edge* e : layers[0]->nextEdges(layers[0]->neurons().size() - 1)) //bias of the input layer
+			dw_first[e] -= delta[e->neuron()->getNeuronId()];
+	}
+
+	for (size_t j = 2; j < dw.size(); j++)
+		forEachShift(layers[j], dw[j], [&](double& x) { x /= ins.size(); });
+	_batch_loss /= ins.size();
 	_n->shiftBackWeights(dw);
+
+	for (auto& e : dw_first)
+		e.first->shiftWeight(e.second / ins.size());
 }
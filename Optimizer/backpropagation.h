@@ -9,15 +9,32 @@
 extern double LEARNING_RATE;
 
 
+//Receives the averaged shifts of each layer as soon as the backward pass of the batch has finished it (last layer
+//first), so they can be combined (e.g. with other processes, see DataParallel) while the pass goes on.
+//The shifts are applied when wait() returns true.
+class GradientExchange
+{
+public:
+	virtual ~GradientExchange() {}
+
+	//dw ([neuron][incoming edge]) stays untouched by the caller until wait() returns
+	virtual void submit(size_t layer, vector<vector<double> >& dw) = 0;
+
+	virtual bool wait() = 0;
+};
+
 class Backpropagation : public Optimizer
 {
 
 public:
 	void setLearningRate(double lr);
 
-	vector<vector<vector<double> > > getBackpropagationShifts(const vector<double>& in, const vector<double>& out);
+	vector<vector<vector<double> > > getBackpropagationShifts(const Row& in, const Row& out);
+
+	void backpropagate(const vector<Row>& ins, const vector<Row>& outs);
 
-	void backpropagate(const vector<const vector<double>*>& ins, const vector<const vector<double>*>& outs);
+	//Same update for sparse inputs: the first layer only reads and updates the weights of the nonzero features
+	void backpropagate(const vector<SparseRow>& ins, const vector<Row>& outs);
 
 	vector<Layer*> getLayers();
 
@@ -25,8 +42,16 @@ public:
 
 	void setBatchSize(size_t bs);
 
+	//mean loss of the last backpropagated batch, from the same pass as the shifts
+	double batchLoss() const;
+
+	//dense batches only, null to disable
+	void setGradientExchange(GradientExchange* exchange);
+
 private:
 	size_t _batch_size = 20;
+	double _batch_loss = 0;
+	GradientExchange* _exchange = nullptr;
 };
 
 
@@ -0,0 +1,223 @@
+#include "checkpoint.h"
+#include "../dataset/datasetformat.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#define CHECKPOINT_MAGIC "NNCKPT1"
+#define CHECKPOINT_VERSION 3
+
+//followed by the weights (n_weights doubles), the best weights (n_best_weights doubles, 0 or n_weights), the
+//pruning mask (mask_bytes, 0 or n_weights, see NeuralNetwork::getPruneMask) and the optimizer state (state_bytes),
+//padded to 8 bytes
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t iteration;
+	uint64_t seed;
+	double best_score;
+	double learning_rate;
+	uint64_t n_weights;
+	uint64_t n_best_weights;
+	uint64_t mask_bytes;
+	uint64_t state_bytes;
+	uint64_t checksum; //datasetChecksum of everything after the header
+};
+
+
+Checkpointer::Checkpointer(const string& filename, NeuralNetwork* n, Optimizer* opt) :
+	_filename(filename), _n(n), _opt(opt)
+{
+	_thread = thread(&Checkpointer::loop, this);
+}
+
+Checkpointer::~Checkpointer()
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	_thread.join();
+}
+
+void Checkpointer::save(const TrainingState& state)
+{
+	Pending p;
+	p.state = state;
+	p.learning_rate = LEARNING_RATE;
+	p.weights = _n->getFlatWeights();
+	if (_n->sparsity() > 0)
+		p.mask = _n->getPruneMask();
+	ostringstream ss;
+	_opt->saveState(ss);
+	p.optimizer_state = ss.str();
+	{
+		lock_guard<mutex> lock(_mutex);
+		_pending = move(p);
+		_has_pending = true;
+	}
+	_cv.notify_all();
+	srand(uint(state.seed + state.iteration));
+}
+
+bool Checkpointer::wait()
+{
+	unique_lock<mutex> lock(_mutex);
+	_cv.wait(lock, [&]() { return !_has_pending && !_writing; });
+	return _ok;
+}
+
+//the last pending checkpoint is written even when stopping
+void Checkpointer::loop()
+{
+	unique_lock<mutex> lock(_mutex);
+	while (true)
+	{
+		_cv.wait(lock, [&]() { return _has_pending || _stop; });
+		if (!_has_pending)
+			break;
+		Pending p = move(_pending);
+		_has_pending = false;
+		_writing = true;
+		lock.unlock();
+		bool ok = write(p);
+		lock.lock();
+		_writing = false;
+		_ok = ok;
+		_cv.notify_all();
+	}
+}
+
+bool Checkpointer::write(const Pending& p)
+{
+	string body((p.weights.size() + p.state.best_weights.size()) * sizeof(double), '\0');
+	memcpy(&body[0], p.weights.data(), p.weights.size() * sizeof(double));
+	memcpy(&body[p.weights.size() * sizeof(double)], p.state.best_weights.data(), p.state.best_weights.size() * sizeof(double));
+	body.append(p.mask.begin(), p.mask.end());
+	body += p.optimizer_state;
+	body.resize((body.size() + 7) / 8 * 8, '\0');
+
+	CheckpointHeader h = {};
+	memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	h.version = CHECKPOINT_VERSION;
+	h.iteration = p.state.iteration;
+	h.seed = p.state.seed;
+	h.best_score = p.state.best_score;
+	h.learning_rate = p.learning_rate;
+	h.n_weights = p.weights.size();
+	h.n_best_weights = p.state.best_weights.size();
+	h.mask_bytes = p.mask.size();
+	h.state_bytes = p.optimizer_state.size();
+	h.checksum = datasetChecksum(body.data(), body.size());
+
+	string tmp = _filename + ".tmp";
+#ifndef _WIN32
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool ok = ::write(fd, &h, sizeof(h)) == ssize_t(sizeof(h));
+	for (size_t done = 0; ok && done < body.size();)
+	{
+		ssize_t w = ::write(fd, body.data() + done, body.size() - done);
+		ok = w > 0;
+		done += ok ? w : 0;
+	}
+	ok = ok && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	if (!ok || rename(tmp.c_str(), _filename.c_str()) != 0)
+		return false;
+
+	//the rename itself must reach the disk
+	size_t slash = _filename.find_last_of('/');
+	string dir = slash == string::npos ? "." : _filename.substr(0, slash + 1);
+	int dfd = open(dir.c_str(), O_RDONLY);
+	if (dfd >= 0)
+	{
+		fsync(dfd);
+		close(dfd);
+	}
+	return true;
+#else
+	HANDLE file = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD w = 0;
+	bool ok = WriteFile(file, &h, sizeof(h), &w, nullptr) && w == sizeof(h);
+	for (size_t done = 0; ok && done < body.size(); done += w)
+		ok = WriteFile(file, body.data() + done, DWORD(min<size_t>(body.size() - done, 1 << 30)), &w, nullptr) && w > 0;
+	ok = ok && FlushFileBuffers(file);
+	ok = CloseHandle(file) && ok;
+	//replaces the checkpoint in one step, and returns once the rename is on disk
+	return ok && MoveFileExA(tmp.c_str(), _filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#endif
+}
+
+static bool readHeader(ifstream& file, CheckpointHeader& h)
+{
+	return file.read(reinterpret_cast<char*>(&h), sizeof(h))
+		&& memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) == 0 && h.version == CHECKPOINT_VERSION;
+}
+
+bool Checkpointer::readState(const string& filename, TrainingState& state)
+{
+	ifstream file(filename, ios::binary);
+	CheckpointHeader h;
+	if (!readHeader(file, h))
+		return false;
+	state.iteration = h.iteration;
+	state.seed = h.seed;
+	state.best_score = h.best_score;
+	return true;
+}
+
+bool Checkpointer::resume(TrainingState& state)
+{
+	ifstream file(_filename, ios::binary);
+	CheckpointHeader h;
+	if (!readHeader(file, h))
+		return false;
+	if (h.n_weights != _n->getFlatWeights().size() || (h.n_best_weights != 0 && h.n_best_weights != h.n_weights)
+		|| (h.mask_bytes != 0 && h.mask_bytes != h.n_weights))
+	{
+		cerr << "checkpoint " << _filename << " does not match the network" << endl;
+		return false;
+	}
+	size_t weights_bytes = h.n_weights * sizeof(double);
+	size_t best_bytes = h.n_best_weights * sizeof(double);
+	string body((weights_bytes + best_bytes + h.mask_bytes + h.state_bytes + 7) / 8 * 8, '\0');
+	if (!file.read(&body[0], body.size()) || datasetChecksum(body.data(), body.size()) != h.checksum)
+	{
+		cerr << "corrupted checkpoint " << _filename << endl;
+		return false;
+	}
+
+	istringstream ss(body.substr(weights_bytes + best_bytes + h.mask_bytes, h.state_bytes));
+	if (!_opt->loadState(ss))
+		return false;
+	vector<double> weights(h.n_weights);
+	memcpy(weights.data(), body.data(), weights_bytes);
+	if (h.mask_bytes)
+		_n->setPruneMask(vector<char>(body.begin() + weights_bytes + best_bytes, body.begin() + weights_bytes + best_bytes + h.mask_bytes));
+	_n->setFlatWeights(weights);
+	LEARNING_RATE = h.learning_rate;
+	state.iteration = h.iteration;
+	state.seed = h.seed;
+	state.best_score = h.best_score;
+	state.best_weights.resize(h.n_best_weights);
+	memcpy(state.best_weights.data(), body.data() + weights_bytes, best_bytes);
+	srand(uint(state.seed + state.iteration));
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "optimizer.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Position of the training loop stored with a checkpoint
+struct TrainingState
+{
+	uint64_t iteration = 0;
+	double best_score = 1;
+	uint64_t seed = 0; //seeds the run (see readState), then rand() is seeded with seed + iteration at every checkpoint and on resume
+	vector<double> best_weights; //weights that scored best_score, in getFlatWeights order (empty: the current ones)
+};
+
+//Checkpoints of a training run: weights, pruning mask, optimizer state, LEARNING_RATE and the TrainingState (with
+//the best weights). A pruned run resumes into the complete network it started from.
+//save() only copies the state in memory; a background thread serializes it, fsyncs it to a temporary file and
+//renames it over the checkpoint, so the file on disk is always a complete checkpoint. If a write is still
+//running, the newest checkpoint replaces the queued one.
+class Checkpointer
+{
+public:
+	Checkpointer(const string& filename, NeuralNetwork* n, Optimizer* opt);
+
+	~Checkpointer();
+
+	void save(const TrainingState& state);
+
+	//Loads the checkpoint into the network and the optimizer (false if there is none or it does not match)
+	bool resume(TrainingState& state);
+
+	//Reads the iteration, seed and best score of a checkpoint, nothing else. A resumed run must seed rand() with the
+	//seed before it does what depends on it, like splitting the dataset, to continue on the same TRAIN/TEST split
+	static bool readState(const string& filename, TrainingState& state);
+
+	//blocks until the queued checkpoint is on disk
+	bool wait();
+
+private:
+	struct Pending
+	{
+		TrainingState state;
+		double learning_rate;
+		vector<double> weights;
+		vector<char> mask;
+		string optimizer_state;
+	};
+
+	void loop();
+
+	bool write(const Pending& p);
+
+	string _filename;
+	NeuralNetwork* _n;
+	Optimizer* _opt;
+
+	Pending _pending;
+	bool _has_pending = false;
+	bool _writing = false;
+	bool _ok = true;
+	bool _stop = false;
+	mutex _mutex;
+	condition_variable _cv;
+	thread _thread;
+};
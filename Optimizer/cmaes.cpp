@@ -0,0 +1,235 @@
+#include "cmaes.h"
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <cmath>
+
+
+
+Cmaes::Cmaes()
+{
+
+}
+
+
+Cmaes::~Cmaes()
+{
+	for (NeuralNetwork* w : _workers)
+		delete w;
+}
+
+void Cmaes::setSigma(double sigma)
+{
+	_sigma = sigma;
+}
+
+void Cmaes::setPopulationSize(size_t lambda)
+{
+	_lambda = lambda;
+}
+
+void Cmaes::setEvalSize(size_t eval_size)
+{
+	_eval_size = eval_size;
+}
+
+void Cmaes::setThreads(size_t n_threads)
+{
+	_n_threads = n_threads;
+}
+
+double Cmaes::getBestScore() const
+{
+	return _best_score;
+}
+
+const vector<double>& Cmaes::getBest() const
+{
+	return _best;
+}
+
+
+void Cmaes::init()
+{
+	_mean = _n->getFlatWeights();
+	_dim = _mean.size();
+	double N = double(_dim);
+
+	if (_lambda == 0)
+		_lambda = 4 + size_t(3 * log(N));
+	_lambda = max<size_t>(_lambda, 2); //at least one parent
+	_mu = _lambda / 2;
+
+	_weights.resize(_mu);
+	for (size_t i = 0; i < _mu; i++)
+		_weights[i] = log(_mu + 0.5) - log(i + 1.0);
+	double sw = accumulate(_weights.begin(), _weights.end(), 0.0);
+	double sw2 = 0;
+	for (double& w : _weights)
+	{
+		w /= sw;
+		sw2 += w * w;
+	}
+	_mueff = 1 / sw2;
+
+	_cs = (_mueff + 2) / (N + _mueff + 5);
+	_ds = 1 + 2 * max(0.0, sqrt((_mueff - 1) / (N + 1)) - 1) + _cs;
+	_cc = (4 + _mueff / N) / (N + 4 + 2 * _mueff / N);
+	//learning rates of the full CMA-ES, scaled up by (N + 2) / 3 for the diagonal model
+	_c1 = 2 / ((N + 1.3) * (N + 1.3) + _mueff) * (N + 2) / 3;
+	_cmu = min(1 - _c1, 2 * (_mueff - 2 + 1 / _mueff) / ((N + 2) * (N + 2) + _mueff) * (N + 2) / 3);
+	_chin = sqrt(N) * (1 - 1 / (4 * N) + 1 / (21 * N * N));
+
+	_c.assign(_dim, 1);
+	_ps.assign(_dim, 0);
+	_pc.assign(_dim, 0);
+	_z.resize(_lambda * _dim);
+	_x.resize(_lambda * _dim);
+	_fitness.resize(_lambda);
+
+	if (_n_threads == 0)
+		_n_threads = max(1u, thread::hardware_concurrency());
+	_n_threads = min(_n_threads, _lambda);
+	for (size_t i = 0; i < _n_threads; i++)
+		_workers.push_back(_n->clone());
+
+	cout << _dim << " parameters, population " << _lambda << ", " << _n_threads << " threads" << endl;
+}
+
+
+void Cmaes::minimize()
+{
+	if (_dim == 0)
+		init();
+
+	//sample x = m + sigma * sqrt(C) z
+	std::normal_distribution<double> rnorm(0, 1);
+	for (size_t k = 0; k < _lambda; k++)
+	{
+		double* z = &_z[k * _dim];
+		double* x = &_x[k * _dim];
+		for (size_t i = 0; i < _dim; i++)
+		{
+			z[i] = rnorm(_generator);
+			x[i] = _mean[i] + _sigma * sqrt(_c[i]) * z[i];
+		}
+	}
+
+	//the whole population is scored on the same samples
+	_ids.resize(_eval_size);
+	for (size_t i = 0; i < _eval_size; i++)
+		_ids[i] = rand() % _d->getOuts(TRAIN).size();
+	evaluatePopulation();
+
+	vector<size_t> order(_lambda);
+	iota(order.begin(), order.end(), 0);
+	sort(order.begin(), order.end(), [&](size_t a, size_t b) { return _fitness[a] < _fitness[b]; });
+
+	if (_fitness[order[0]] < _best_score)
+	{
+		_best_score = _fitness[order[0]];
+		_best.assign(_x.begin() + order[0] * _dim, _x.begin() + (order[0] + 1) * _dim);
+	}
+
+	//recombination, evolution paths and covariance update
+	double cs = sqrt(_cs * (2 - _cs) * _mueff);
+	double cc = sqrt(_cc * (2 - _cc) * _mueff);
+	double norm_ps = 0;
+	vector<double> yw(_dim);
+	for (size_t i = 0; i < _dim; i++)
+	{
+		double zw = 0;
+		for (size_t j = 0; j < _mu; j++)
+			zw += _weights[j] * _z[order[j] * _dim + i];
+		yw[i] = sqrt(_c[i]) * zw;
+		_mean[i] += _sigma * yw[i];
+		_ps[i] = (1 - _cs) * _ps[i] + cs * zw;
+		norm_ps += _ps[i] * _ps[i];
+	}
+	norm_ps = sqrt(norm_ps);
+
+	_generation++;
+	bool hsig = norm_ps / sqrt(1 - pow(1 - _cs, 2.0 * _generation)) / _chin < 1.4 + 2 / (_dim + 1.0);
+
+	for (size_t i = 0; i < _dim; i++)
+	{
+		_pc[i] = (1 - _cc) * _pc[i] + (hsig ? cc * yw[i] : 0);
+		double rank_mu = 0;
+		for (size_t j = 0; j < _mu; j++)
+		{
+			double y = sqrt(_c[i]) * _z[order[j] * _dim + i];
+			rank_mu += _weights[j] * y * y;
+		}
+		double rank_one = _pc[i] * _pc[i] + (hsig ? 0 : _cc * (2 - _cc) * _c[i]);
+		_c[i] = (1 - _c1 - _cmu) * _c[i] + _c1 * rank_one + _cmu * rank_mu;
+	}
+
+	_sigma *= exp((_cs / _ds) * (norm_ps / _chin - 1));
+
+	_n->setFlatWeights(_mean);
+	return;
+}
+
+
+void Cmaes::evaluatePopulation()
+{
+	vector<thread> t;
+	size_t per_thread = (_lambda + _n_threads - 1) / _n_threads;
+	for (size_t w = 0; w < _n_threads; w++)
+	{
+		size_t begin = w * per_thread;
+		size_t end = min(_lambda, begin + per_thread);
+		if (begin < end)
+			t.push_back(thread(&Cmaes::evaluateRange, this, w, begin, end));
+	}
+	for (size_t i = 0; i < t.size(); i++)
+		t[i].join();
+}
+
+
+// each worker owns a copy of the network, so candidates never share neuron state
+void Cmaes::evaluateRange(size_t worker, size_t begin, size_t end)
+{
+	NeuralNetwork* n = _workers[worker];
+	for (size_t k = begin; k < end; k++)
+	{
+		n->setFlatWeights(&_x[k * _dim]);
+		_fitness[k] = n->predictSubsetForScore(*_d, TRAIN, _ids);
+	}
+}
+
+//the distribution, the best solution and the generator; the strategy parameters are derived again by init()
+void Cmaes::saveState(ostream& out) const
+{
+	writeValues(out, _mean);
+	writeValues(out, _c);
+	writeValues(out, _ps);
+	writeValues(out, _pc);
+	writeValues(out, _best);
+	out.write(reinterpret_cast<const char*>(&_sigma), sizeof(_sigma));
+	out.write(reinterpret_cast<const char*>(&_best_score), sizeof(_best_score));
+	out.write(reinterpret_cast<const char*>(&_generation), sizeof(_generation));
+	out << _generator << '\n';
+}
+
+bool Cmaes::loadState(istream& in)
+{
+	vector<double> mean, c, ps, pc;
+	if (!readValues(in, mean) || !readValues(in, c) || !readValues(in, ps) || !readValues(in, pc) || !readValues(in, _best))
+		return false;
+	if (mean.empty()) //saved before the first generation
+		return true;
+	if (_dim == 0)
+		init();
+	if (mean.size() != _dim)
+		return false;
+	_mean = move(mean);
+	_c = move(c);
+	_ps = move(ps);
+	_pc = move(pc);
+	in.read(reinterpret_cast<char*>(&_sigma), sizeof(_sigma));
+	in.read(reinterpret_cast<char*>(&_best_score), sizeof(_best_score));
+	in.read(reinterpret_cast<char*>(&_generation), sizeof(_generation));
+	in >> _generator;
+	return bool(in);
+}
@@ -0,0 +1,68 @@
+#pragma once
+// Separable (diagonal) CMA-ES, see Ros & Hansen, "A Simple Modification in CMA-ES Achieving Linear Time and Space Complexity"
+
+#include "optimizer.h"
+#include <random>
+
+class Cmaes : public Optimizer
+{
+public:
+	Cmaes();
+	~Cmaes();
+
+	//one generation: sample the population, evaluate it, update the distribution. The network gets the mean.
+	void minimize();
+
+	void setSigma(double sigma);
+
+	//at least 2
+	void setPopulationSize(size_t lambda);
+
+	void setEvalSize(size_t eval_size);
+
+	void setThreads(size_t n_threads);
+
+	double getBestScore() const;
+
+	const vector<double>& getBest() const;
+
+	void saveState(ostream& out) const;
+
+	bool loadState(istream& in);
+
+private:
+	void init();
+
+	void evaluatePopulation();
+
+	void evaluateRange(size_t worker, size_t begin, size_t end);
+
+	default_random_engine _generator;
+
+	size_t _dim = 0;
+	size_t _lambda = 0; //0 means the default 4 + 3 ln(N)
+	size_t _mu = 0;
+	size_t _eval_size = 100; //samples shared by the whole population in a generation
+	size_t _n_threads = 0; //0 means hardware_concurrency
+
+	//strategy parameters
+	vector<double> _weights;
+	double _mueff = 0, _cs = 0, _ds = 0, _cc = 0, _c1 = 0, _cmu = 0, _chin = 0;
+
+	//state, flat arrays
+	double _sigma = 0.5;
+	vector<double> _mean;
+	vector<double> _c; //diagonal of the covariance
+	vector<double> _ps;
+	vector<double> _pc;
+	vector<double> _z; //_lambda x _dim
+	vector<double> _x; //_lambda x _dim
+	vector<double> _fitness;
+	vector<size_t> _ids; //evaluation subset of the current generation
+
+	vector<double> _best;
+	double _best_score = numeric_limits<double>::max();
+	uint _generation = 0;
+
+	vector<NeuralNetwork*> _workers;
+};
@@ -0,0 +1,100 @@
+#include "crossvalidation.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+
+
+CrossValidation::CrossValidation(const Dataset& data, size_t k, size_t repeats, unsigned seed) :
+	_data(data), _k(k), _repeats(repeats), _seed(seed)
+{
+	//one shuffle per repeat, cut in k contiguous folds
+	vector<size_t> ids(_data.size());
+	for (size_t r = 0; r < _repeats; r++)
+	{
+		iota(ids.begin(), ids.end(), 0);
+		shuffle(ids.begin(), ids.end(), mt19937(_seed + unsigned(r)));
+		for (size_t f = 0; f < _k; f++)
+			_folds.push_back(vector<size_t>(ids.begin() + ids.size() * f / _k, ids.begin() + ids.size() * (f + 1) / _k));
+	}
+}
+
+void CrossValidation::run(const function<NeuralNetwork*()>& build, const function<Optimizer*()>& optimizer,
+	const function<void(NeuralNetwork&, Dataset&, Optimizer&)>& train, double learning_rate, size_t n_threads)
+{
+	_results.assign(_folds.size(), FoldResult());
+	if (n_threads == 0)
+		n_threads = max(1u, thread::hardware_concurrency());
+
+	//the constructors write LEARNING_RATE: all of them run here, before any fold reads it
+	double caller_rate = LEARNING_RATE;
+	vector<unique_ptr<Optimizer> > opts;
+	for (size_t i = 0; i < _folds.size(); i++)
+		opts.push_back(unique_ptr<Optimizer>(optimizer()));
+	LEARNING_RATE = learning_rate;
+
+	atomic<size_t> next(0);
+	vector<thread> t;
+	for (size_t i = 0; i < min(n_threads, _folds.size()); i++)
+		t.push_back(thread([&]() {
+			for (size_t f = next++; f < _folds.size(); f = next++)
+				runFold(f, build, *opts[f], train);
+		}));
+	for (size_t i = 0; i < t.size(); i++)
+		t[i].join();
+	LEARNING_RATE = caller_rate;
+}
+
+void CrossValidation::runFold(size_t i, const function<NeuralNetwork*()>& build, Optimizer& opt,
+	const function<void(NeuralNetwork&, Dataset&, Optimizer&)>& train)
+{
+	size_t repeat = i / _k;
+	size_t fold = i % _k;
+
+	vector<size_t> train_ids;
+	train_ids.reserve(_data.size() - _folds[i].size());
+	for (size_t f = 0; f < _k; f++)
+		if (f != fold)
+			train_ids.insert(train_ids.end(), _folds[repeat * _k + f].begin(), _folds[repeat * _k + f].end());
+	Dataset fold_data(_data, move(train_ids), _folds[i]);
+
+	NeuralNetwork* n = build();
+	opt.setNeuralNetwork(n);
+	opt.setDataset(&fold_data);
+	train(*n, fold_data, opt);
+	_results[i] = { repeat, fold, n->predictAllForScore(fold_data, TRAIN), n->predictAllForScore(fold_data, TEST) };
+	delete n;
+}
+
+const vector<CrossValidation::FoldResult>& CrossValidation::getResults() const
+{
+	return _results;
+}
+
+double CrossValidation::meanTestScore() const
+{
+	if (_results.empty())
+		return 0;
+	double s = 0;
+	for (const FoldResult& r : _results)
+		s += r.test_score;
+	return s / _results.size();
+}
+
+double CrossValidation::stddevTestScore() const
+{
+	double m = meanTestScore();
+	double s = 0;
+	for (const FoldResult& r : _results)
+		s += (r.test_score - m) * (r.test_score - m);
+	return _results.size() > 1 ? sqrt(s / (_results.size() - 1)) : 0;
+}
+
+void CrossValidation::printResults() const
+{
+	for (const FoldResult& r : _results)
+		cout << "repeat:" << r.repeat << "  fold:" << r.fold << "    test_score:" << r.test_score << "    train_score:" << r.train_score << endl;
+	cout << "mean test_score:" << meanTestScore() << "  (stddev " << stddevTestScore() << ")" << endl;
+}
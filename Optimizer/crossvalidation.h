@@ -0,0 +1,49 @@
+#pragma once
+
+#include "optimizer.h"
+#include <functional>
+#include <memory>
+
+//(Repeated) k-fold cross-validation. Every fold is a Dataset sharing the samples of the source, and the folds are
+//trained concurrently, one independent network each.
+//LEARNING_RATE is global and optimizer constructors write it: run() builds the optimizer of every fold before the
+//threads start, then sets learning_rate once. The train function must use the optimizer it gets, and must neither
+//construct an Optimizer nor change LEARNING_RATE.
+class CrossValidation
+{
+public:
+	struct FoldResult
+	{
+		size_t repeat;
+		size_t fold;
+		double train_score;
+		double test_score;
+	};
+
+	CrossValidation(const Dataset& data, size_t k, size_t repeats = 1, unsigned seed = 0);
+
+	//build creates a fresh network, optimizer a fresh optimizer. train fits the network on the TRAIN split of the fold
+	//dataset it gets, with the optimizer already set on both. The caller's LEARNING_RATE is restored on return.
+	void run(const function<NeuralNetwork*()>& build, const function<Optimizer*()>& optimizer,
+		const function<void(NeuralNetwork&, Dataset&, Optimizer&)>& train, double learning_rate, size_t n_threads = 0);
+
+	const vector<FoldResult>& getResults() const;
+
+	double meanTestScore() const;
+
+	double stddevTestScore() const;
+
+	void printResults() const;
+
+private:
+	void runFold(size_t i, const function<NeuralNetwork*()>& build, Optimizer& opt,
+		const function<void(NeuralNetwork&, Dataset&, Optimizer&)>& train);
+
+	const Dataset& _data;
+	size_t _k;
+	size_t _repeats;
+	unsigned _seed;
+
+	vector<vector<size_t> > _folds; //_repeats * _k sets of sample indices
+	vector<FoldResult> _results;
+};
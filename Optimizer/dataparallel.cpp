@@ -0,0 +1,250 @@
+#include "dataparallel.h"
+#include "allreduce.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#include <csignal>
+#endif
+
+
+//start of the shifts of each layer in the flat gradient ([neuron][incoming edge], getEdges order), size + 1 entries
+static vector<size_t> layerOffsets(NeuralNetwork& n)
+{
+	vector<size_t> offsets(1, 0);
+	for (Layer* l : n.getLayers())
+	{
+		size_t size = 0;
+		if (l->getId() > 0)
+			for (Neuron* ne : l->neurons())
+				size += ne->_previous.size();
+		offsets.push_back(offsets.back() + size);
+	}
+	return offsets;
+}
+
+//Copies each submitted layer to its place in a flat gradient and sums it over the ranks on a communication thread,
+//in submission order (the same on every rank). wait() writes the averages back.
+class AllreduceExchange : public GradientExchange
+{
+public:
+	AllreduceExchange(ShmAllreduce* ring, const vector<size_t>& offsets) :
+		_ring(ring), _offsets(offsets), _flat(offsets.back())
+	{
+		_thread = thread(&AllreduceExchange::loop, this);
+	}
+
+	~AllreduceExchange()
+	{
+		{
+			lock_guard<mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cv.notify_all();
+		_thread.join();
+	}
+
+	void submit(size_t layer, vector<vector<double> >& dw)
+	{
+		double* v = &_flat[_offsets[layer]];
+		for (const vector<double>& neuron : dw)
+			for (double x : neuron)
+				*v++ = x;
+		lock_guard<mutex> lock(_mutex);
+		_jobs.push_back({ layer, &dw });
+		_cv.notify_all();
+	}
+
+	bool wait()
+	{
+		unique_lock<mutex> lock(_mutex);
+		_cv.wait(lock, [&] { return _done == _jobs.size(); });
+		double scale = 1.0 / _ring->ranks();
+		for (const Job& j : _jobs)
+		{
+			const double* v = &_flat[_offsets[j.layer]];
+			for (vector<double>& neuron : *j.dw)
+				for (double& x : neuron)
+					x = *v++ * scale;
+		}
+		_jobs.clear();
+		_done = 0;
+		return _ok;
+	}
+
+	bool failed()
+	{
+		lock_guard<mutex> lock(_mutex);
+		return !_ok;
+	}
+
+private:
+	struct Job
+	{
+		size_t layer;
+		vector<vector<double> >* dw;
+	};
+
+	void loop()
+	{
+		unique_lock<mutex> lock(_mutex);
+		while (true)
+		{
+			_cv.wait(lock, [&] { return _stop || _done < _jobs.size(); });
+			if (_stop)
+				return;
+			size_t layer = _jobs[_done].layer;
+			lock.unlock();
+			size_t begin = _offsets[layer], end = _offsets[layer + 1];
+			bool ok = _ring->allreduce(&_flat[begin], begin, end - begin);
+			lock.lock();
+			_ok = _ok && ok;
+			_done++;
+			_cv.notify_all();
+		}
+	}
+
+	ShmAllreduce* _ring;
+	vector<size_t> _offsets;
+	vector<double> _flat;
+	vector<Job> _jobs;
+	size_t _done = 0;
+	bool _ok = true;
+	bool _stop = false;
+	mutex _mutex;
+	condition_variable _cv;
+	thread _thread;
+};
+
+//training loop of one rank
+static bool runRank(ShmAllreduce& ring, NeuralNetwork& n, Dataset& d, size_t batch_size, size_t steps,
+	const function<void(size_t, NeuralNetwork&)>& report, size_t report_every)
+{
+	RowView train = d.getIns(TRAIN);
+	vector<size_t> shard;
+	for (size_t i = ring.rank(); i < train.size(); i += ring.ranks())
+		shard.push_back(train.id(i));
+	Dataset local(d, shard, {});
+
+	//the Optimizer constructor resets LEARNING_RATE, every rank trains with the caller's
+	double rate = LEARNING_RATE;
+	Backpropagation opt;
+	LEARNING_RATE = rate;
+	opt.setBatchSize(batch_size);
+	opt.setNeuralNetwork(&n);
+	opt.setDataset(&local);
+	AllreduceExchange exchange(&ring, layerOffsets(n));
+	opt.setGradientExchange(&exchange);
+
+	for (size_t s = 0; s < steps; s++)
+	{
+		opt.minimize();
+		if (exchange.failed())
+		{
+			ring.abort();
+			return false;
+		}
+		if (ring.rank() == 0 && report && s % report_every == 0)
+			report(s, n);
+	}
+	return true;
+}
+
+
+DataParallel::DataParallel(size_t n_processes, size_t batch_size) :
+	_n_processes(n_processes), _batch_size(batch_size)
+{
+}
+
+bool DataParallel::train(NeuralNetwork& n, Dataset& d, size_t steps, const function<void(size_t, NeuralNetwork&)>& report, size_t report_every)
+{
+#ifndef _WIN32
+	if (d.isSparse() || _n_processes == 0 || d.getIns(TRAIN).size() < _n_processes)
+	{
+		cerr << "data parallel training needs a dense dataset with at least one TRAIN sample per process" << endl;
+		return false;
+	}
+	string name = "/nn_allreduce_" + to_string(getpid());
+	if (!ShmAllreduce::create(name, _n_processes, layerOffsets(n).back()))
+		return false;
+	ShmAllreduce ring(name, 0);
+	double caller_rate = LEARNING_RATE;
+
+	//buffered output would be written again by every worker
+	cout.flush();
+	fflush(stdout);
+	unsigned seed = rand();
+	pid_t parent = getpid();
+	vector<pid_t> workers;
+	bool ok = ring.isOpen();
+	for (size_t r = 1; r < _n_processes && ok; r++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+#ifdef __linux__
+			prctl(PR_SET_PDEATHSIG, SIGTERM); //workers do not outlive rank 0
+			if (getppid() != parent)
+				_exit(1);
+#endif
+			srand(seed + r);
+			ShmAllreduce worker_ring(name, r);
+			_exit(worker_ring.isOpen() && runRank(worker_ring, n, d, _batch_size, steps, nullptr, report_every) ? 0 : 1);
+		}
+		if (pid < 0)
+			ok = false;
+		else
+			workers.push_back(pid);
+	}
+	if (!ok)
+		ring.abort();
+
+	//a worker that fails aborts the ring, so that no rank waits for it forever
+	atomic<bool> workers_ok(true);
+	thread monitor([&] {
+		size_t alive = workers.size();
+		while (alive > 0)
+		{
+			for (pid_t& pid : workers)
+			{
+				int status = 0;
+				if (pid <= 0 || waitpid(pid, &status, WNOHANG) != pid)
+					continue;
+				pid = 0;
+				alive--;
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				{
+					workers_ok = false;
+					ring.abort();
+				}
+			}
+			this_thread::sleep_for(chrono::milliseconds(10));
+		}
+	});
+
+	if (ok)
+	{
+		srand(seed);
+		ok = runRank(ring, n, d, _batch_size, steps, report, report_every);
+		if (!ok)
+			ring.abort();
+	}
+	monitor.join();
+	ShmAllreduce::unlink(name);
+	LEARNING_RATE = caller_rate;
+	return ok && workers_ok;
+#else
+	return false;
+#endif
+}
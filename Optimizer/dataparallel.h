@@ -0,0 +1,26 @@
+#pragma once
+
+#include "backpropagation.h"
+#include <functional>
+
+//Data parallel Backpropagation over processes of one host. train() forks n_processes - 1 workers, this process
+//being rank 0. Every rank trains its copy of the network on its own shard of the TRAIN split (every
+//n_processes-th sample) and, after each step, the shifts are averaged over the ranks with a ShmAllreduce. Only the
+//backward pass of the last sample of a batch overlaps the communication: each layer is exchanged as soon as that
+//pass is done with it (see GradientExchange). All the copies apply the same shifts, so they keep the same weights:
+//one step is a batch of n_processes x batch_size samples.
+//Dense datasets only; the workers inherit the network, the dataset and LEARNING_RATE when they are forked, every
+//rank trains with the caller's LEARNING_RATE and train() leaves it unchanged.
+class DataParallel
+{
+public:
+	DataParallel(size_t n_processes, size_t batch_size = 20);
+
+	//Runs steps training steps, report is called by rank 0 every report_every steps (the other ranks wait for it
+	//in the next exchange). Returns false if a process failed, n then holds the weights of the last complete step.
+	bool train(NeuralNetwork& n, Dataset& d, size_t steps, const function<void(size_t, NeuralNetwork&)>& report = nullptr, size_t report_every = 100);
+
+private:
+	size_t _n_processes;
+	size_t _batch_size;
+};
@@ -1,5 +1,7 @@
 #include "optimizer.h"
 #include <thread>
+#include <algorithm>
+#include <cmath>
 
 
 Optimizer::Optimizer()
@@ -44,3 +46,85 @@ double Optimizer::getScore(Datatype d, int limit)
 {
 	return _n->predictAllForScore(*_d,d, limit);
 }
+
+double Optimizer::getScoreDirectional(Datatype d, const vector<double>& direction, double& dscore, int limit)
+{
+	_n->setDirection(direction);
+	return _n->predictAllForScoreDirectional(*_d, dscore, d, limit);
+}
+
+void Optimizer::setSequentialScoring(double z, size_t increment)
+{
+	_seq_z = z;
+	_seq_increment = max<size_t>(increment, 1);
+}
+
+void Optimizer::saveState(ostream&) const
+{
+}
+
+bool Optimizer::loadState(istream&)
+{
+	return true;
+}
+
+//size, then the raw doubles
+void Optimizer::writeValues(ostream& out, const vector<double>& v)
+{
+	uint64_t n = v.size();
+	out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+	out.write(reinterpret_cast<const char*>(v.data()), n * sizeof(double));
+}
+
+bool Optimizer::readValues(istream& in, vector<double>& v)
+{
+	uint64_t n = 0;
+	in.read(reinterpret_cast<char*>(&n), sizeof(n));
+	if (!in)
+		return false;
+	v.resize(n);
+	in.read(reinterpret_cast<char*>(v.data()), n * sizeof(double));
+	return bool(in);
+}
+
+bool Optimizer::compareSequential(const function<void()>& apply, const function<void()>& revert, size_t max_samples)
+{
+	RowView outs = _d->getOuts(TRAIN);
+	vector<size_t> ids(_seq_increment);
+	vector<double> base(_seq_increment);
+
+	//running mean and variance of (candidate - baseline), Welford
+	double mean = 0, m2 = 0;
+	size_t n = 0;
+	while (true)
+	{
+		for (size_t i = 0; i < _seq_increment; i++)
+		{
+			ids[i] = rand() % outs.size();
+			_n->predict(*_d, TRAIN, ids[i]);
+			base[i] = _n->outputLoss(outs[ids[i]]);
+		}
+		apply();
+		for (size_t i = 0; i < _seq_increment; i++)
+		{
+			_n->predict(*_d, TRAIN, ids[i]);
+			double delta = _n->outputLoss(outs[ids[i]]) - base[i];
+			n++;
+			double d = delta - mean;
+			mean += d / n;
+			m2 += d * (delta - mean);
+		}
+
+		double bound = n > 1 ? _seq_z * sqrt(m2 / (n - 1) / n) : numeric_limits<double>::max();
+		if (mean + bound < 0)
+			return true;
+		if (mean - bound > 0 || (n >= max_samples && mean > 0))
+		{
+			revert();
+			return false;
+		}
+		if (n >= max_samples)
+			return true;
+		revert();
+	}
+}
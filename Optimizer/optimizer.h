@@ -2,13 +2,15 @@
 
 #include "../dataset/dataset.h"
 #include "../neural/neuralnetwork.h"
+#include <functional>
+#include <iostream>
 
 
 class Optimizer
 {
 public:
 	Optimizer();
-	~Optimizer();
+	virtual ~Optimizer();
 
 	virtual void minimize();
 
@@ -18,11 +20,33 @@ public:
 
 	double getScore(Datatype d, int limit = -1);
 
+	//score and its derivative along direction (one value per edge, in NeuralNetwork::getEdges order)
+	double getScoreDirectional(Datatype d, const vector<double>& direction, double& dscore, int limit = -1);
+
 	void minimizeThread();
 
+	//Paired sequential comparison between the current weights and the candidate set by apply() (undone by revert()).
+	//Both are scored on the same samples, drawn in increments, until the confidence bound on the mean difference
+	//excludes zero or max_samples is reached. Returns true (candidate left applied) if the candidate is better.
+	bool compareSequential(const function<void()>& apply, const function<void()>& revert, size_t max_samples);
+
+	void setSequentialScoring(double z, size_t increment = 5);
+
+	//Internal state needed to continue an interrupted run (see Checkpointer). The default has no state.
+	virtual void saveState(ostream& out) const;
+
+	virtual bool loadState(istream& in);
+
 protected:
+	static void writeValues(ostream& out, const vector<double>& v);
+
+	static bool readValues(istream& in, vector<double>& v);
+
 	NeuralNetwork* _n;
 
 	Dataset* _d;
 
+	double _seq_z = 2.0; //half-width of the confidence bound, in standard errors
+	size_t _seq_increment = 5;
+
 };
@@ -0,0 +1,25 @@
+#include "pruning.h"
+#include <algorithm>
+#include <cmath>
+
+
+Pruner::Pruner(NeuralNetwork* n, double final_sparsity, uint begin, uint end, uint frequency, double initial_sparsity) :
+	_n(n), _final_sparsity(final_sparsity), _initial_sparsity(initial_sparsity), _begin(begin), _end(max(end, begin + 1)),
+	_frequency(max(frequency, 1u))
+{
+}
+
+double Pruner::targetSparsity(uint iteration) const
+{
+	if (iteration < _begin)
+		return 0;
+	double progress = min(1.0, double(iteration - _begin) / (_end - _begin));
+	return _final_sparsity + (_initial_sparsity - _final_sparsity) * pow(1 - progress, 3);
+}
+
+bool Pruner::step(uint iteration)
+{
+	if (iteration < _begin || iteration > _end || ((iteration - _begin) % _frequency != 0 && iteration != _end))
+		return false;
+	return _n->prune(targetSparsity(iteration)) > 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../neural/neuralnetwork.h"
+
+//Gradual magnitude pruning during training (Zhu & Gupta, "To prune, or not to prune").
+//Between the iterations begin and end, every frequency iterations, the network is pruned to the sparsity
+//s = final + (initial - final) (1 - progress)^3, removing the smallest weights fast first and slowly near the end.
+//The pruned edges are masked (zero weight that training leaves alone), so the snapshots, optimizers and checkpoints
+//of the network stay valid. Above FLAT_SPARSE_THRESHOLD, a layer is trained through the list of its unpruned edges
+//(see NeuralNetwork::updateSparse) and FlatNetwork stores it in CSR form.
+class Pruner
+{
+public:
+	Pruner(NeuralNetwork* n, double final_sparsity, uint begin, uint end, uint frequency = 100, double initial_sparsity = 0);
+
+	//call once per iteration, returns true if the network was pruned
+	bool step(uint iteration);
+
+	double targetSparsity(uint iteration) const;
+
+private:
+	NeuralNetwork* _n;
+	double _final_sparsity;
+	double _initial_sparsity;
+	uint _begin;
+	uint _end;
+	uint _frequency;
+};
@@ -27,9 +27,18 @@ void Shakingtree::minimizeBasic()
 {
 	mapParameters();
 
-	//get a score
 	int batch_size = 20;
 	int weight_amplitude = 5;
+	if (_sequential)
+	{
+		int i = rand() % _p.size();
+		double oldp = _p[i]->weight();
+		double newp = random(-weight_amplitude, weight_amplitude);
+		compareSequential([&]() { _p[i]->alterWeight(newp); }, [&]() { _p[i]->alterWeight(oldp); }, batch_size);
+		return;
+	}
+
+	//get a score
 	double s = getScore(TRAIN, batch_size);
 
 	//choose a parameter to change
@@ -56,6 +65,22 @@ void Shakingtree::minimizeBasicLarger()
 	size_t n_new_parameters = 5;// int(0.1 * _p_ids.size());
 	unsigned seed = (unsigned int)(std::chrono::system_clock::now().time_since_epoch().count());
 	std::shuffle(_p_ids.begin(), _p_ids.end(), std::default_random_engine(seed));
+
+	if (_sequential)
+	{
+		vector<double> old_p, new_p;
+		for (size_t j = 0; j < n_new_parameters; j++)
+		{
+			old_p.push_back(_p[_p_ids[j]]->weight());
+			new_p.push_back(random(-weight_amplitude, weight_amplitude));
+		}
+		compareSequential(
+			[&]() { for (size_t j = 0; j < n_new_parameters; j++) _p[_p_ids[j]]->alterWeight(new_p[j]); },
+			[&]() { for (size_t j = 0; j < n_new_parameters; j++) _p[_p_ids[j]]->alterWeight(old_p[j]); },
+			batch_size);
+		return;
+	}
+
 	double s = getScore(TRAIN, batch_size);
 
 	//choose multiple parameters to change
@@ -151,6 +176,76 @@ void Shakingtree::minimizeComplex()
 }
 
 
+// Same as minimizeComplex, but the delta score of a shift is estimated with one forward-mode pass
+// (first order along the shift) instead of shifting, rescoring and resetting the weights
+void Shakingtree::minimizeComplexForward()
+{
+	mapParameters();
+
+	//PHASE 1 : draw the shift
+	size_t EVALSIZE = 100;
+	std::normal_distribution<double> rnorm(0, _step);
+	vector<double> neww(_p.size());
+	for (size_t i = 0; i < _p.size(); i++)
+		neww[i] = rnorm(_generator);
+
+	//PHASE 2 : directional derivative of the score along the shift (the weights are never touched)
+	//shiftWeight scales by LEARNING_RATE, so that is the step the derivative is taken for
+	double dscore;
+	srand(_total_iter);
+	getScoreDirectional(TRAIN, neww, dscore, EVALSIZE);
+
+	_delta_score.push_back(dscore * LEARNING_RATE);
+	_shift.push_back(move(neww));
+
+	//PHASE 3 : identical to minimizeComplex
+	if (_shift.size() == size_t(_itmod))
+	{
+		uint gscore = 0;
+		for (size_t j = 0; j < _shift.size(); j++)
+			if (_delta_score[j] < 0)
+			{
+				for (size_t i = 0; i < _p.size(); i++)
+					_p[i]->shiftWeight(_shift[j][i] * LEARNING_RATE);
+				gscore++;
+			}
+
+		if (gscore == 0)
+			_nogoodscore_iter++;
+		else
+			_nogoodscore_iter = 0;
+
+		_shift.clear();
+		_delta_score.clear();
+		_total_iter++;
+	}
+
+	return;
+}
+
+
+// Forward gradient: for a random direction v, (grad.v) v is an unbiased (up to _step^2) estimate of the gradient
+void Shakingtree::minimizeForwardGradient()
+{
+	mapParameters();
+
+	size_t EVALSIZE = 100;
+	std::normal_distribution<double> rnorm(0, _step);
+	vector<double> v(_p.size());
+	for (size_t i = 0; i < _p.size(); i++)
+		v[i] = rnorm(_generator);
+
+	double dscore;
+	getScoreDirectional(TRAIN, v, dscore, EVALSIZE);
+
+	for (size_t i = 0; i < _p.size(); i++)
+		_p[i]->shiftWeight(-dscore * v[i]);
+	_total_iter++;
+
+	return;
+}
+
+
 void Shakingtree::minimizeBasicPerLayer()
 {
 	mapParameters();
@@ -174,6 +269,36 @@ void Shakingtree::minimizeBasicPerLayer()
 }
 
 
+// Line search on one weight at a time: every candidate in [-7, 7] and the current weight are scored in one pass
+void Shakingtree::minimizeCoordinateSearch()
+{
+	mapParameters();
+
+	vector<Edge*>& layer = _p2[rand() % _p2.size()];
+	vector<double> candidates(_n_candidates + 1);
+
+	for (size_t i = 0; i < 100; i++)
+	{
+		Edge* e = layer[rand() % layer.size()];
+		candidates[0] = e->weight();
+		for (size_t k = 1; k < candidates.size(); k++)
+			candidates[k] = -7 + 14.0 * (k - 1 + random(0, 1)) / _n_candidates;
+
+		auto scores = _n->scoreEdgeCandidates(e, candidates, *_d, TRAIN, 100);
+		size_t best = min_element(scores.begin(), scores.end()) - scores.begin();
+		e->alterWeight(candidates[best]);
+	}
+
+	return;
+}
+
+
+void Shakingtree::setSequential(bool sequential)
+{
+	_sequential = sequential;
+}
+
+
 // easier access to parameters for the optimizer
 void Shakingtree::mapParameters()
 {
@@ -197,3 +322,38 @@ void Shakingtree::mapParameters()
 
 
 
+
+//accumulated shifts and delta scores, counters, step and the generator
+void Shakingtree::saveState(ostream& out) const
+{
+	uint64_t n_shift = _shift.size();
+	out.write(reinterpret_cast<const char*>(&n_shift), sizeof(n_shift));
+	for (const vector<double>& s : _shift)
+		writeValues(out, s);
+	writeValues(out, _delta_score);
+	out.write(reinterpret_cast<const char*>(&_total_iter), sizeof(_total_iter));
+	out.write(reinterpret_cast<const char*>(&_nogoodscore_iter), sizeof(_nogoodscore_iter));
+	out.write(reinterpret_cast<const char*>(&_step), sizeof(_step));
+	out.write(reinterpret_cast<const char*>(&_itmod), sizeof(_itmod));
+	out << _generator << '\n';
+}
+
+bool Shakingtree::loadState(istream& in)
+{
+	uint64_t n_shift = 0;
+	in.read(reinterpret_cast<char*>(&n_shift), sizeof(n_shift));
+	if (!in)
+		return false;
+	_shift.resize(n_shift);
+	for (vector<double>& s : _shift)
+		if (!readValues(in, s))
+			return false;
+	if (!readValues(in, _delta_score))
+		return false;
+	in.read(reinterpret_cast<char*>(&_total_iter), sizeof(_total_iter));
+	in.read(reinterpret_cast<char*>(&_nogoodscore_iter), sizeof(_nogoodscore_iter));
+	in.read(reinterpret_cast<char*>(&_step), sizeof(_step));
+	in.read(reinterpret_cast<char*>(&_itmod), sizeof(_itmod));
+	in >> _generator;
+	return bool(in);
+}
@@ -18,10 +18,23 @@ public:
 
 	void minimizeComplex();
 
+	void minimizeComplexForward();
+
+	void minimizeForwardGradient();
+
 	void minimizeBasicPerLayer();
 
+	void minimizeCoordinateSearch();
+
 	void mapParameters();
 
+	//minimizeBasic and minimizeBasicLarger decide with compareSequential instead of two fixed-size scores
+	void setSequential(bool sequential);
+
+	void saveState(ostream& out) const;
+
+	bool loadState(istream& in);
+
 private:
 	default_random_engine _generator;
 	vector<Edge*> _p;
@@ -32,6 +45,9 @@ private:
 	vector<double> _delta_score;
 	int _itmod = 10; //state how much test you want to accumulate before accepting the delta score
 	double _step = 0.05;
+	size_t _n_candidates = 16; //candidate values per coordinate for minimizeCoordinateSearch
+
+	bool _sequential = false;
 
 	uint _total_iter = 0;
 	uint _nogoodscore_iter = 0;
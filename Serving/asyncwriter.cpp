@@ -0,0 +1,75 @@
+#include "asyncwriter.h"
+
+#include <algorithm>
+
+
+AsyncWriter::AsyncWriter(const string& filename, size_t max_pending) :
+	_file_buffer(1 << 20), _max_pending(max(max_pending, size_t(1)))
+{
+	_file.rdbuf()->pubsetbuf(_file_buffer.data(), _file_buffer.size());
+	_file.open(filename, ios::binary);
+	if (_file)
+		_thread = thread(&AsyncWriter::loop, this);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+	close();
+}
+
+bool AsyncWriter::isOpen() const
+{
+	return bool(_file.is_open());
+}
+
+void AsyncWriter::write(size_t seq, string&& chunk)
+{
+	unique_lock<mutex> lock(_mutex);
+	_cv.wait(lock, [&]() { return seq < _next + _max_pending || _stop; });
+	if (_stop)
+		return;
+	_pending[seq] = move(chunk);
+	_cv.notify_all();
+}
+
+void AsyncWriter::loop()
+{
+	unique_lock<mutex> lock(_mutex);
+	while (true)
+	{
+		_cv.wait(lock, [&]() { return _stop || (!_pending.empty() && _pending.begin()->first == _next); });
+		if (_pending.empty() || _pending.begin()->first != _next)
+			break;
+
+		//take every chunk that is ready, write them without the lock
+		string out;
+		while (!_pending.empty() && _pending.begin()->first == _next)
+		{
+			out += _pending.begin()->second;
+			_pending.erase(_pending.begin());
+			_next++;
+		}
+		_cv.notify_all();
+		lock.unlock();
+		_file.write(out.data(), out.size());
+		lock.lock();
+	}
+}
+
+bool AsyncWriter::close()
+{
+	{
+		lock_guard<mutex> lock(_mutex);
+		if (_closed)
+			return bool(_file);
+		_closed = true;
+		_stop = true;
+	}
+	_cv.notify_all();
+	if (_thread.joinable())
+		_thread.join();
+	if (!_file.is_open())
+		return false;
+	_file.close();
+	return !_file.fail();
+}
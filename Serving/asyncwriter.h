@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+//Writes numbered chunks to a file in sequence order on a background thread, whatever the order they are
+//handed in. A chunk more than max_pending ahead of the next one to write blocks its producer.
+class AsyncWriter
+{
+public:
+	AsyncWriter(const string& filename, size_t max_pending = 64);
+	~AsyncWriter();
+
+	bool isOpen() const;
+
+	void write(size_t seq, string&& chunk);
+
+	//waits for every chunk up to the last one handed in, then flushes the file
+	bool close();
+
+private:
+	void loop();
+
+	ofstream _file;
+	vector<char> _file_buffer;
+	map<size_t, string> _pending;
+	size_t _next = 0;
+	size_t _max_pending;
+	bool _stop = false;
+	bool _closed = false;
+	mutex _mutex;
+	condition_variable _cv;
+	thread _thread;
+};
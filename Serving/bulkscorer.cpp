@@ -0,0 +1,223 @@
+#include "bulkscorer.h"
+#include "asyncwriter.h"
+#include "../dataset/mappedfile.h"
+#include "../dataset/datasetformat.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <cmath>
+#include <cstring>
+
+
+BulkScorer::BulkScorer(const FlatNetwork* model, size_t n_threads, size_t batch_rows) :
+	_model(model), _n_threads(n_threads ? n_threads : max(1u, thread::hardware_concurrency())), _batch_rows(max(batch_rows, size_t(1)))
+{
+	_width = model->inputSize();
+	_n_outputs = model->outputSize();
+}
+
+bool BulkScorer::run(const string& input, const string& output)
+{
+	MappedFile file(input);
+	if (!file.isOpen())
+	{
+		cerr << "cannot read " << input << endl;
+		return false;
+	}
+	AsyncWriter writer(output, 4 * _n_threads);
+	if (!writer.isOpen())
+	{
+		cerr << "cannot write " << output << endl;
+		return false;
+	}
+
+	_file = &file;
+	_binary = file.size() >= sizeof(DatasetHeader) && memcmp(file.data(), DATASET_MAGIC, sizeof(DATASET_MAGIC)) == 0;
+	_cursor = file.data();
+	_next_seq = 0;
+	if (_binary)
+	{
+		DatasetHeader h;
+		memcpy(&h, file.data(), sizeof(h));
+		if (!datasetHeaderValid(h, file.size()))
+		{
+			cerr << "invalid binary input " << input << endl;
+			return false;
+		}
+		if (h.features != _width)
+		{
+			cerr << "binary input does not match the network (" << h.features << " features, " << _width << " inputs)" << endl;
+			return false;
+		}
+		_features = reinterpret_cast<const double*>(file.data() + h.features_offset);
+		_file_rows = h.rows;
+	}
+
+	vector<vector<double> > latencies(_n_threads);
+	vector<size_t> rows(_n_threads, 0), malformed(_n_threads, 0);
+	auto start = chrono::steady_clock::now();
+	vector<thread> t;
+	for (size_t i = 0; i < _n_threads; i++)
+		t.push_back(thread([&, i]() {
+			vector<double> in, outs, workspace;
+			Batch b;
+			while (nextBatch(b))
+			{
+				auto t0 = chrono::steady_clock::now();
+				string out;
+				scoreBatch(b, out, in, outs, workspace, rows[i], malformed[i]);
+				latencies[i].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count());
+				writer.write(b.seq, move(out));
+			}
+		}));
+	for (auto& th : t)
+		th.join();
+	bool ok = writer.close();
+	_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	_rows = 0;
+	_malformed = 0;
+	_latencies.clear();
+	for (size_t i = 0; i < _n_threads; i++)
+	{
+		_rows += rows[i];
+		_malformed += malformed[i];
+		_latencies.insert(_latencies.end(), latencies[i].begin(), latencies[i].end());
+	}
+	sort(_latencies.begin(), _latencies.end());
+	_file = nullptr;
+	if (!ok)
+		cerr << "cannot write " << output << endl;
+	return ok;
+}
+
+//binary: fixed ranges of rows. Text: the next batch_rows lines from the shared cursor
+bool BulkScorer::nextBatch(Batch& b)
+{
+	lock_guard<mutex> lock(_mutex);
+	if (_binary)
+	{
+		b.first_row = _next_seq * _batch_rows;
+		if (b.first_row >= _file_rows)
+			return false;
+		b.n_rows = min(_batch_rows, _file_rows - b.first_row);
+	}
+	else
+	{
+		const char* end = _file->data() + _file->size();
+		if (_cursor >= end)
+			return false;
+		b.begin = _cursor;
+		for (size_t i = 0; i < _batch_rows && _cursor < end; i++)
+		{
+			const char* nl = static_cast<const char*>(memchr(_cursor, '\n', end - _cursor));
+			_cursor = nl ? nl + 1 : end;
+		}
+		b.end = _cursor;
+	}
+	b.seq = _next_seq++;
+	return true;
+}
+
+//the whole batch goes through the network in one forwardBatch; malformed text lines get nan outputs
+void BulkScorer::scoreBatch(const Batch& b, string& out, vector<double>& in, vector<double>& outs, vector<double>& workspace, size_t& rows, size_t& malformed)
+{
+	char buffer[32];
+	auto append = [&](size_t n) {
+		out.reserve(n * _n_outputs * 20);
+		for (size_t k = 0; k < n * _n_outputs; k++)
+		{
+			char* e = to_chars(buffer, buffer + sizeof(buffer), outs[k]).ptr;
+			out.append(buffer, e);
+			out.push_back((k + 1) % _n_outputs ? ' ' : '\n');
+		}
+		rows += n;
+	};
+
+	if (_binary)
+	{
+		outs.resize(b.n_rows * _n_outputs);
+		_model->forwardBatch(_features + b.first_row * _width, b.n_rows, outs.data(), workspace);
+		append(b.n_rows);
+		return;
+	}
+
+	in.resize(_batch_rows * _width);
+	vector<bool> bad;
+	size_t n = 0;
+	for (const char* p = b.begin; p < b.end;)
+	{
+		const char* nl = static_cast<const char*>(memchr(p, '\n', b.end - p));
+		const char* e = nl ? nl : b.end;
+
+		//the first _width values of the line
+		double* values = &in[n * _width];
+		size_t k = 0;
+		bool blank = true;
+		for (const char* q = p; k < _width;)
+		{
+			while (q < e && (*q == ' ' || *q == '\t' || *q == ',' || *q == '\r'))
+				q++;
+			if (q == e)
+				break;
+			blank = false;
+			if (*q == '+')
+				q++;
+			auto res = from_chars(q, e, values[k]);
+			if (res.ec != errc())
+				break;
+			q = res.ptr;
+			k++;
+		}
+		p = e + 1;
+		if (blank)
+			continue;
+		bad.push_back(k < _width);
+		if (k < _width)
+		{
+			malformed++;
+			fill(values, values + _width, 0.0);
+		}
+		n++;
+	}
+
+	outs.resize(n * _n_outputs);
+	_model->forwardBatch(in.data(), n, outs.data(), workspace);
+	for (size_t r = 0; r < n; r++)
+		if (bad[r])
+			fill(&outs[r * _n_outputs], &outs[(r + 1) * _n_outputs], NAN);
+	append(n);
+}
+
+size_t BulkScorer::rowsScored() const
+{
+	return _rows;
+}
+
+size_t BulkScorer::malformedRows() const
+{
+	return _malformed;
+}
+
+double BulkScorer::rowsPerSecond() const
+{
+	return _seconds > 0 ? _rows / _seconds : 0;
+}
+
+double BulkScorer::batchLatency(double p) const
+{
+	if (_latencies.empty())
+		return 0;
+	size_t i = min(_latencies.size() - 1, size_t(p / 100 * _latencies.size()));
+	return _latencies[i];
+}
+
+void BulkScorer::printReport(ostream& out) const
+{
+	out << "rows: " << _rows << "    malformed: " << _malformed << "    time: " << _seconds << "s    rows/s: " << rowsPerSecond() << endl;
+	out << "batch latency (ms)    p50: " << batchLatency(50) << "    p90: " << batchLatency(90) << "    p99: " << batchLatency(99)
+		<< "    max: " << batchLatency(100) << endl;
+}
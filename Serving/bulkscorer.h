@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../neural/flatnetwork.h"
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+
+using namespace std;
+
+class MappedFile;
+
+//Offline scoring of a whole file with a trained network.
+//The input is either text (one sample per line, the first values are the inputs of the network, extra columns
+//such as a target are ignored) or a binary dataset file (see datasetformat.h). It is mapped and cut in batches of
+//batch_rows samples; every worker thread scores whole batches with its own workspace, and an AsyncWriter
+//puts the outputs back in input order, one line per sample (nan for malformed lines, blank lines are skipped).
+class BulkScorer
+{
+public:
+	BulkScorer(const FlatNetwork* model, size_t n_threads = 0, size_t batch_rows = 4096);
+
+	bool run(const string& input, const string& output);
+
+	size_t rowsScored() const;
+
+	size_t malformedRows() const;
+
+	double rowsPerSecond() const;
+
+	//p-th percentile (0 to 100) of the time spent scoring one batch, in milliseconds
+	double batchLatency(double p) const;
+
+	void printReport(ostream& out = cout) const;
+
+private:
+	struct Batch
+	{
+		size_t seq;
+		const char* begin; //text
+		const char* end;
+		size_t first_row; //binary
+		size_t n_rows;
+	};
+
+	bool nextBatch(Batch& b);
+
+	void scoreBatch(const Batch& b, string& out, vector<double>& in, vector<double>& outs, vector<double>& workspace, size_t& rows, size_t& malformed);
+
+	const FlatNetwork* _model;
+	size_t _n_threads;
+	size_t _batch_rows;
+	size_t _width = 0;
+	size_t _n_outputs = 0;
+
+	//input being scored
+	const MappedFile* _file = nullptr;
+	bool _binary = false;
+	const double* _features = nullptr;
+	size_t _file_rows = 0;
+	const char* _cursor = nullptr;
+	size_t _next_seq = 0;
+	mutex _mutex;
+
+	//report of the last run
+	size_t _rows = 0;
+	size_t _malformed = 0;
+	double _seconds = 0;
+	vector<double> _latencies;
+};
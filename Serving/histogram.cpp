@@ -0,0 +1,44 @@
+#include "histogram.h"
+#include <cmath>
+#include <algorithm>
+
+
+void Histogram::add(double v)
+{
+	size_t b = v < 1 ? 0 : min<size_t>(_buckets.size() - 1, size_t(log2(v)) + 1);
+	_buckets[b]++;
+	_count++;
+	_max = v > _max ? v : _max;
+}
+
+size_t Histogram::count() const
+{
+	return _count;
+}
+
+double Histogram::max() const
+{
+	return _max;
+}
+
+double Histogram::percentile(double p) const
+{
+	size_t target = size_t(ceil(p / 100 * _count));
+	size_t seen = 0;
+	for (size_t b = 0; b < _buckets.size(); b++)
+	{
+		seen += _buckets[b];
+		if (seen >= target && seen > 0)
+			return min(_max, b == 0 ? 1 : ldexp(1.0, int(b)));
+	}
+	return 0;
+}
+
+void Histogram::print(ostream& out, const string& name) const
+{
+	out << name << "    n: " << _count << "    p50: " << percentile(50) << "    p90: " << percentile(90)
+		<< "    p99: " << percentile(99) << "    max: " << _max << endl;
+	for (size_t b = 0; b < _buckets.size(); b++)
+		if (_buckets[b])
+			out << "    < " << ldexp(1.0, int(b)) << "\t" << _buckets[b] << endl;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+using namespace std;
+
+//Counts of positive values in power of two buckets: bucket 0 holds [0, 1), bucket b holds [2^(b-1), 2^b)
+class Histogram
+{
+public:
+	void add(double v);
+
+	size_t count() const;
+
+	double max() const;
+
+	//upper bound of the bucket holding the p-th percentile (0 to 100), at most max()
+	double percentile(double p) const;
+
+	void print(ostream& out, const string& name) const;
+
+private:
+	vector<size_t> _buckets = vector<size_t>(64, 0);
+	size_t _count = 0;
+	double _max = 0;
+};
@@ -0,0 +1,298 @@
+#include "inferenceserver.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+
+InferenceServer::InferenceServer(const FlatNetwork* model, size_t n_workers, size_t max_batch, double max_wait_us, size_t max_request_rows) :
+	_model(model), _n_workers(n_workers ? n_workers : max(1u, thread::hardware_concurrency())),
+	_max_batch(max(max_batch, size_t(1))), _max_request_rows(max_request_rows), _max_wait(long(max_wait_us))
+{
+}
+
+InferenceServer::~InferenceServer()
+{
+	stop();
+}
+
+InferenceServer::Connection::~Connection()
+{
+#ifndef _WIN32
+	close(fd);
+#endif
+}
+
+#ifndef _WIN32
+static bool readFull(int fd, void* data, size_t n)
+{
+	char* p = static_cast<char*>(data);
+	while (n > 0)
+	{
+		ssize_t r = recv(fd, p, n, 0);
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+static bool writeFull(int fd, const void* data, size_t n)
+{
+	const char* p = static_cast<const char*>(data);
+	while (n > 0)
+	{
+		ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+		if (w <= 0)
+			return false;
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+#endif
+
+bool InferenceServer::start(const string& address)
+{
+#ifndef _WIN32
+	if (address.compare(0, 5, "unix:") == 0)
+	{
+		sockaddr_un a = {};
+		a.sun_family = AF_UNIX;
+		_unix_path = address.substr(5);
+		if (_unix_path.size() >= sizeof(a.sun_path))
+			return false;
+		strcpy(a.sun_path, _unix_path.c_str());
+		unlink(_unix_path.c_str());
+		_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (_listen_fd < 0 || ::bind(_listen_fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0)
+		{
+			cerr << "cannot bind " << address << endl;
+			return false;
+		}
+	}
+	else if (address.compare(0, 4, "tcp:") == 0)
+	{
+		sockaddr_in a = {};
+		a.sin_family = AF_INET;
+		a.sin_port = htons(uint16_t(atoi(address.c_str() + 4)));
+		a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (_listen_fd < 0 || ::bind(_listen_fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0)
+		{
+			cerr << "cannot bind " << address << endl;
+			return false;
+		}
+	}
+	else
+	{
+		cerr << "unknown address " << address << " (unix:<path> or tcp:<port>)" << endl;
+		return false;
+	}
+	if (listen(_listen_fd, 128) != 0)
+		return false;
+
+	_stop = false;
+	for (size_t i = 0; i < _n_workers; i++)
+		_workers.push_back(thread(&InferenceServer::workerLoop, this));
+	_acceptor = thread(&InferenceServer::acceptLoop, this);
+	return true;
+#else
+	cerr << "the inference server needs POSIX sockets" << endl;
+	return false;
+#endif
+}
+
+void InferenceServer::stop()
+{
+#ifndef _WIN32
+	if (_stop.exchange(true))
+		return;
+	if (_listen_fd >= 0)
+		shutdown(_listen_fd, SHUT_RDWR);
+	if (_acceptor.joinable())
+		_acceptor.join();
+	{
+		unique_lock<mutex> lock(_connections_mutex);
+		for (auto& w : _connections)
+			if (auto c = w.lock())
+				shutdown(c->fd, SHUT_RDWR);
+		_readers_done.wait(lock, [&]() { return _n_readers == 0; });
+		_connections.clear();
+	}
+	{
+		lock_guard<mutex> lock(_mutex);
+		_cv.notify_all();
+	}
+	for (auto& t : _workers)
+		t.join();
+	_workers.clear();
+	_queue.clear();
+	_queued_rows = 0;
+	if (_listen_fd >= 0)
+		close(_listen_fd);
+	_listen_fd = -1;
+	if (!_unix_path.empty())
+		unlink(_unix_path.c_str());
+#endif
+}
+
+void InferenceServer::acceptLoop()
+{
+#ifndef _WIN32
+	while (!_stop)
+	{
+		int fd = accept(_listen_fd, nullptr, nullptr);
+		if (fd < 0)
+			break;
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); //fails harmlessly on Unix sockets
+		auto c = make_shared<Connection>();
+		c->fd = fd;
+		lock_guard<mutex> lock(_connections_mutex);
+		if (_stop)
+			break;
+		_connections.erase(remove_if(_connections.begin(), _connections.end(),
+			[](const weak_ptr<Connection>& w) { return w.expired(); }), _connections.end());
+		_connections.push_back(c);
+		_n_readers++;
+		thread(&InferenceServer::readLoop, this, c).detach();
+	}
+#endif
+}
+
+void InferenceServer::readLoop(shared_ptr<Connection> c)
+{
+#ifndef _WIN32
+	const size_t width = _model->inputSize();
+	while (!_stop)
+	{
+		uint32_t head[2];
+		if (!readFull(c->fd, head, sizeof(head)))
+			break;
+		Request r;
+		r.connection = c;
+		r.id = head[0];
+		r.rows = head[1];
+		if (r.rows > _max_request_rows) //the payload is not read, the stream cannot be resynchronized
+		{
+			respond(*c, r.id, 0, nullptr);
+			break;
+		}
+		r.in.resize(size_t(r.rows) * width);
+		if (!readFull(c->fd, r.in.data(), r.in.size() * sizeof(double)))
+			break;
+		r.arrival = chrono::steady_clock::now();
+		if (r.rows == 0)
+		{
+			respond(*c, r.id, 0, nullptr);
+			continue;
+		}
+		lock_guard<mutex> lock(_mutex);
+		_arrival_gap_us = 0.9 * _arrival_gap_us + 0.1 * min(1e9, chrono::duration<double, micro>(r.arrival - _last_arrival).count());
+		_last_arrival = r.arrival;
+		_queued_rows += r.rows;
+		_queue.push_back(move(r));
+		_cv.notify_all();
+	}
+	shutdown(c->fd, SHUT_RDWR);
+	c.reset();
+	lock_guard<mutex> lock(_connections_mutex);
+	_n_readers--;
+	_readers_done.notify_all();
+#endif
+}
+
+void InferenceServer::respond(Connection& c, uint32_t id, uint32_t rows, const double* out)
+{
+#ifndef _WIN32
+	uint32_t head[2] = { id, rows };
+	lock_guard<mutex> lock(c.write_mutex);
+	if (writeFull(c.fd, head, sizeof(head)))
+		writeFull(c.fd, out, size_t(rows) * _model->outputSize() * sizeof(double));
+#endif
+}
+
+//wait for a first request, then for more until the batch is full or the oldest one reaches its deadline
+void InferenceServer::workerLoop()
+{
+	vector<Request> batch;
+	vector<double> in, out, workspace;
+	unique_lock<mutex> lock(_mutex);
+	while (true)
+	{
+		_cv.wait(lock, [&]() { return _stop || !_queue.empty(); });
+		if (_stop)
+			break;
+		if (_arrival_gap_us < _max_wait.count())
+		{
+			auto deadline = _queue.front().arrival + _max_wait;
+			_cv.wait_until(lock, deadline, [&]() { return _stop || _queued_rows >= _max_batch || _queue.empty(); });
+		}
+		if (_stop)
+			break;
+		if (_queue.empty()) //taken by another worker
+			continue;
+
+		size_t depth = _queue.size();
+		size_t rows = 0;
+		batch.clear();
+		while (!_queue.empty() && (batch.empty() || rows + _queue.front().rows <= _max_batch))
+		{
+			rows += _queue.front().rows;
+			_queued_rows -= _queue.front().rows;
+			batch.push_back(move(_queue.front()));
+			_queue.pop_front();
+		}
+		if (!_queue.empty())
+			_cv.notify_all();
+		lock.unlock();
+
+		size_t width = _model->inputSize();
+		in.resize(rows * width);
+		out.resize(rows * _model->outputSize());
+		size_t offset = 0;
+		for (Request& r : batch)
+		{
+			copy(r.in.begin(), r.in.end(), in.begin() + offset * width);
+			offset += r.rows;
+		}
+		_model->forwardBatch(in.data(), rows, out.data(), workspace);
+
+		offset = 0;
+		auto now = chrono::steady_clock::now();
+		for (Request& r : batch)
+		{
+			respond(*r.connection, r.id, r.rows, &out[offset * _model->outputSize()]);
+			offset += r.rows;
+		}
+		{
+			lock_guard<mutex> stats(_stats_mutex);
+			for (Request& r : batch)
+				_latency.add(chrono::duration<double, micro>(now - r.arrival).count());
+			_queue_depth.add(double(depth));
+			_batch_rows.add(double(rows));
+		}
+		batch.clear();
+		lock.lock();
+	}
+}
+
+void InferenceServer::printStats(ostream& out)
+{
+	lock_guard<mutex> lock(_stats_mutex);
+	_latency.print(out, "latency (us)");
+	_queue_depth.print(out, "queue depth (requests)");
+	_batch_rows.print(out, "batch (rows)");
+}
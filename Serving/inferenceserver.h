@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../neural/flatnetwork.h"
+#include "histogram.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+//Serves a model over a Unix domain socket ("unix:<path>") or localhost TCP ("tcp:<port>").
+//Protocol, little endian, any number of requests per connection:
+//  request:  uint32 id, uint32 rows, rows x inputSize() doubles
+//  response: uint32 id, uint32 rows, rows x outputSize() doubles (rows = 0 if the request was invalid)
+//A request of more than max_request_rows rows is answered with rows = 0 and its connection is closed.
+//Requests from all the connections go to one queue. A worker takes the queued requests as one micro-batch once
+//max_batch rows are waiting or the oldest request has waited max_wait_us, and runs them in a single forwardBatch.
+//The wait adapts to the load: when requests arrive further apart than max_wait_us on average, waiting would not
+//grow the batch, so a request is run as soon as a worker is free.
+class InferenceServer
+{
+public:
+	InferenceServer(const FlatNetwork* model, size_t n_workers = 0, size_t max_batch = 256, double max_wait_us = 200, size_t max_request_rows = 65536);
+
+	~InferenceServer();
+
+	bool start(const string& address);
+
+	void stop();
+
+	//latency (arrival to response, us), queue depth when a batch is taken, and rows per batch
+	void printStats(ostream& out = cout);
+
+private:
+	//closed when the reader and the queued requests are done with it
+	struct Connection
+	{
+		int fd;
+		mutex write_mutex;
+		~Connection();
+	};
+
+	struct Request
+	{
+		shared_ptr<Connection> connection;
+		uint32_t id;
+		uint32_t rows;
+		vector<double> in;
+		chrono::steady_clock::time_point arrival;
+	};
+
+	void acceptLoop();
+
+	void readLoop(shared_ptr<Connection> c);
+
+	void workerLoop();
+
+	void respond(Connection& c, uint32_t id, uint32_t rows, const double* out);
+
+	const FlatNetwork* _model;
+	size_t _n_workers;
+	size_t _max_batch;
+	size_t _max_request_rows;
+	chrono::microseconds _max_wait;
+
+	int _listen_fd = -1;
+	string _unix_path;
+	atomic<bool> _stop{ false };
+	thread _acceptor;
+	vector<thread> _workers;
+	vector<weak_ptr<Connection> > _connections;
+	size_t _n_readers = 0;
+	mutex _connections_mutex;
+	condition_variable _readers_done;
+
+	deque<Request> _queue;
+	size_t _queued_rows = 0;
+	chrono::steady_clock::time_point _last_arrival;
+	double _arrival_gap_us = 1e9; //moving average of the time between two requests
+	mutex _mutex;
+	condition_variable _cv;
+
+	Histogram _latency;
+	Histogram _queue_depth;
+	Histogram _batch_rows;
+	mutex _stats_mutex;
+};
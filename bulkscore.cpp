@@ -0,0 +1,41 @@
+#include "neural/flatnetwork.h"
+#include "serving/bulkscorer.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <memory>
+
+using namespace std;
+
+
+double LEARNING_RATE = 0.5;
+
+
+//Scores a text or binary file with a saved model: bulkscore <model> <input> <output> [threads] [batch_rows]
+int main(int argc, char *argv[])
+{
+	if (argc < 4)
+	{
+		cout << "usage: " << argv[0] << " <model> <input> <output> [threads] [batch_rows]" << endl;
+		return 1;
+	}
+
+	//binary models are used in place, text models are flattened once
+	unique_ptr<FlatNetwork> model(new FlatNetwork(argv[1]));
+	if (!model->isOpen())
+	{
+		NeuralNetwork n;
+		if (!n.load(argv[1]))
+		{
+			cerr << "cannot load model " << argv[1] << endl;
+			return 1;
+		}
+		model.reset(new FlatNetwork(n));
+	}
+
+	BulkScorer scorer(model.get(), argc > 4 ? atoi(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 4096);
+	if (!scorer.run(argv[2], argv[3]))
+		return 1;
+	scorer.printReport();
+	return 0;
+}
@@ -0,0 +1,37 @@
+#include "dataset/synthetic.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+
+//Synthetic dataset for scaling tests: datagen <output> [rows] [features] [informative] [seed] [--binary]
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		cout << "usage: " << argv[0] << " <output> [rows] [features] [informative] [seed] [--binary]" << endl;
+		return 1;
+	}
+
+	bool binary = false;
+	unordered_map<string, double> parameters;
+	const char* names[] = { "rows", "features", "informative", "seed" };
+	int n = 0;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--binary") == 0)
+			binary = true;
+		else if (n < 4)
+			parameters[names[n++]] = atof(argv[i]);
+	}
+
+	if (!generateDataset(argv[1], parameters, binary))
+	{
+		cerr << "cannot write " << argv[1] << endl;
+		return 1;
+	}
+	return 0;
+}
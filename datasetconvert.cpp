@@ -0,0 +1,24 @@
+#include "dataset/dataset.h"
+
+#include <iostream>
+
+using namespace std;
+
+
+//Converts a text dataset to the binary format: datasetconvert data1000.txt data1000.nnds
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		cout << "usage: " << argv[0] << " <input.txt> <output.nnds>" << endl;
+		return 1;
+	}
+
+	Dataset data(argv[1]);
+	if (!data.saveBinary(argv[2]))
+	{
+		cerr << "cannot write " << argv[2] << endl;
+		return 1;
+	}
+	return 0;
+}
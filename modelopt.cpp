@@ -0,0 +1,48 @@
+#include "neural/flatnetwork.h"
+
+#include <iostream>
+#include <memory>
+
+using namespace std;
+
+
+double LEARNING_RATE = 0.5;
+
+
+//Optimizes a saved model for deployment: modelopt <model> <output.nnm>
+int main(int argc, char *argv[])
+{
+	if (argc != 3)
+	{
+		cout << "usage: " << argv[0] << " <model> <output.nnm>" << endl;
+		return 1;
+	}
+
+	unique_ptr<FlatNetwork> model(new FlatNetwork(argv[1]));
+	if (!model->isOpen())
+	{
+		NeuralNetwork n;
+		if (!n.load(argv[1]))
+		{
+			cerr << "cannot load model " << argv[1] << endl;
+			return 1;
+		}
+		model.reset(new FlatNetwork(n));
+	}
+
+	unique_ptr<FlatNetwork> optimized(model->optimized());
+	auto print = [](const char* name, const FlatNetwork& f) {
+		cout << name;
+		for (auto& l : f.layers())
+			cout << " " << l.size;
+		cout << endl;
+	};
+	print("before:", *model);
+	print("after: ", *optimized);
+	if (!optimized->save(argv[2]))
+	{
+		cerr << "cannot write " << argv[2] << endl;
+		return 1;
+	}
+	return 0;
+}
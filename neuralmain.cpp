@@ -1,8 +1,13 @@
 
 #include "neural/neuralnetwork.h"
+#include "neural/flatnetwork.h"
+#include "neural/snapshot.h"
 #include "misc/functions.h"
 #include "optimizer/backpropagation.h"
 #include "optimizer/shakingtree.h"
+#include "optimizer/checkpoint.h"
+#include "optimizer/pruning.h"
+#include "optimizer/dataparallel.h"
 #include "dataset/dataset.h"
 
 #include <ctime>
@@ -33,8 +38,11 @@ double LEARNING_RATE = 0.5000;
 //Main function
 int main(int argc, char *argv[])
 {
-	//Init random and logs if required
-	srand(uint(time(0)));
+	//Init random and logs if required. An interrupted run keeps its seed, so it resumes on the same TRAIN/TEST split
+	TrainingState state;
+	state.seed = uint(time(0));
+	Checkpointer::readState("train.ckpt", state);
+	srand(uint(state.seed));
 	//ofstream logs("logs.txt");
 
 
@@ -71,16 +79,50 @@ int main(int argc, char *argv[])
 
 
 
+	//Optional: prune 90% of the weights between iterations 5000 and 25000 (call pruner.step(i) in the loop)
+	//Pruner pruner(&n, 0.9, 5000, 25000);
+
+	//Optional: data parallel backpropagation over 4 processes, instead of the loop below
+	//DataParallel(4, 60).train(n, data, 20000, [&](size_t it, NeuralNetwork& m) { cout << "it:" << it << "    test_score:" << m.predictAllForScore(data) << endl; });
+
+
 	//Init the main training loop (nb: the goal is to lower the score, score = loss)
 	double lr_reduce_amplitude = 0.9;
 	int lr_reduce_schedule = 500;
 	int n_iteration = 50000;
 	int validate_every = 10;
 	double mintest = 1;
+	int checkpoint_every = 1000;
 	int i = 0;
+
+	//Continue an interrupted run from its last checkpoint
+	Checkpointer checkpoints("train.ckpt", &n, &opt);
+	if (checkpoints.resume(state))
+	{
+		i = int(state.iteration);
+		mintest = state.best_score;
+		cout << "resumed at it:" << i << endl;
+	}
+	SnapshotStore snapshots(&n);
+	WeightSnapshot best = snapshots.snapshot(); //weights of mintest
+	if (state.best_weights.size() == best.size())
+	{
+		WeightSnapshot current = best;
+		n.setFlatWeights(state.best_weights);
+		best = snapshots.snapshot();
+		snapshots.restore(current);
+	}
 	clock_t t = clock();
 	while (i < n_iteration)
 	{
+		if (i % checkpoint_every == 0)
+		{
+			state.iteration = i;
+			state.best_score = mintest;
+			state.best_weights = best.values();
+			checkpoints.save(state);
+		}
+
 		//For Backpropagation: The optimizer reads a batch, pass it in the neural network, computes and apply gradients
 		//For ShakingTree: The behaviour depends but the overall idea is to try random parameters and keep the good ones
 		opt.minimize();
@@ -90,7 +132,11 @@ int main(int argc, char *argv[])
 		{
 			double strain = n.predictAllForScore(data, TRAIN);
 			double stest = n.predictAllForScore(data);
-			mintest = stest < mintest ? stest : mintest;
+			if (stest < mintest)
+			{
+				mintest = stest;
+				best = snapshots.snapshot();
+			}
 			cout << "it:" << i << '\t' << "    test_score:" << stest << "    train_score:" << strain << "   (best_test_score : " << mintest << ")" << endl;
 
 			double delta_t = (clock() - t) / 1000.0;
@@ -106,6 +152,11 @@ int main(int argc, char *argv[])
 		i++;
 	}
 
+	//scored offline with bulkscore
+	snapshots.restore(best);
+	n.save("model.txt");
+	FlatNetwork(n).save("model.nnm");
+
 	getchar();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "neural/flatnetwork.h"
+#include "serving/inferenceserver.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <csignal>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+
+double LEARNING_RATE = 0.5;
+
+static atomic<bool> stop_requested(false);
+
+static void onSignal(int)
+{
+	stop_requested = true;
+}
+
+
+//Serves a saved model until interrupted: servemodel <model> <unix:path|tcp:port> [workers] [max_batch] [max_wait_us] [max_request_rows]
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		cout << "usage: " << argv[0] << " <model> <unix:path|tcp:port> [workers] [max_batch] [max_wait_us] [max_request_rows]" << endl;
+		return 1;
+	}
+
+	unique_ptr<FlatNetwork> model(new FlatNetwork(argv[1]));
+	if (!model->isOpen())
+	{
+		NeuralNetwork n;
+		if (!n.load(argv[1]))
+		{
+			cerr << "cannot load model " << argv[1] << endl;
+			return 1;
+		}
+		model.reset(new FlatNetwork(n));
+	}
+
+	InferenceServer server(model.get(), argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? atoi(argv[4]) : 256, argc > 5 ? atof(argv[5]) : 200,
+		argc > 6 ? atoi(argv[6]) : 65536);
+	if (!server.start(argv[2]))
+		return 1;
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	//stats every 10 seconds and at exit
+	int seconds = 0;
+	while (!stop_requested)
+	{
+		this_thread::sleep_for(chrono::seconds(1));
+		if (++seconds % 10 == 0)
+			server.printStats();
+	}
+	server.stop();
+	server.printStats();
+	return 0;
+}
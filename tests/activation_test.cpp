@@ -0,0 +1,35 @@
+#include "../misc/functions.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+
+//Checks the error bounds of the approximate sigmoid modes (functions.h), for the scalar and the in place array
+//versions. Exits with 1 if a bound is exceeded.
+static bool check(const char* name, ActivationMode mode, double bound)
+{
+	double scalar = sigmoid_max_error(mode);
+
+	vector<double> x;
+	for (double v = -40; v <= 40; v += 1.0 / 4099)
+		x.push_back(v);
+	vector<double> y = x;
+	sigmoid(y.data(), y.size(), mode);
+	double array = 0;
+	for (size_t i = 0; i < x.size(); i++)
+		array = max(array, fabs(y[i] - sigmoid(x[i])));
+
+	bool ok = scalar < bound && array < bound;
+	cout << name << ": max error " << scalar << " (array " << array << "), bound " << bound << (ok ? "  ok" : "  FAILED") << endl;
+	return ok;
+}
+
+int main()
+{
+	bool ok = check("polynomial", POLYNOMIAL_ACTIVATION, SIGMOID_POLYNOMIAL_MAX_ERROR);
+	ok = check("table", TABLE_ACTIVATION, SIGMOID_TABLE_MAX_ERROR) && ok;
+	return ok ? 0 : 1;
+}